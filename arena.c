@@ -0,0 +1,47 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include "arena.h"
+
+/* The alignment of the region of an arena, which is the largest alignment a
+   block may ask for. */
+#define ARENA_ALIGN 64
+
+arena* arena_new(size_t size) {
+  arena* res = (arena*) malloc(sizeof(arena));
+  if (!res) {
+    fprintf(stderr, "arena_new, unable to allocate result\n");
+    exit(1);
+  }
+  size = (size + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
+  res->base = (char*) aligned_alloc(ARENA_ALIGN, size ? size : ARENA_ALIGN);
+  if (!res->base) {
+    fprintf(stderr, "arena_new, unable to allocate region\n");
+    exit(1);
+  }
+  res->size = size;
+  res->used = 0;
+  return res;
+}
+
+void* arena_alloc(arena* a, size_t size, size_t align) {
+  if (align == 0 || align > ARENA_ALIGN || (align & (align - 1)) != 0) {
+    fprintf(stderr, "arena_alloc, alignment is not supported\n");
+    exit(1);
+  }
+  size_t start = (a->used + align - 1) & ~(align - 1);
+  if (start > a->size || size > a->size - start) {
+    fprintf(stderr, "arena_alloc, arena is full\n");
+    exit(1);
+  }
+  a->used = start + size;
+  return a->base + start;
+}
+
+void arena_reset(arena* a) {
+  a->used = 0;
+}
+
+void arena_free(arena* a) {
+  free(a->base);
+  free(a);
+}
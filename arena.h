@@ -0,0 +1,49 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+
+struct arena {
+    char* base;
+    size_t size, used;
+};
+
+typedef struct arena arena;
+
+/* Creates an arena: one region of memory that many objects are carved out 
+   of, one after the other, and that is released all at once. Carving is a
+   bump of an offset, with no bookkeeping for each object, so objects are
+   never freed on their own.
+
+   @param size_t the number of bytes in the region
+   @return arena* a pointer to the arena that has been created
+   */
+arena* arena_new(size_t size);
+
+/* Carves a block out of an arena. An error is raised if the arena does not
+   have room left for the block.
+
+   @param arena* the arena that we are carving from
+   @param size_t the number of bytes in the block
+   @param size_t the alignment of the block, a power of two no larger than 
+   64
+   @return void* a pointer to the block
+   */
+void* arena_alloc(arena* a, size_t size, size_t align);
+
+/* Releases every block carved from an arena at once, so that its whole 
+   region can be carved again. Nothing carved before the reset may be used
+   after it.
+
+   @param arena* the arena that we are resetting
+   */
+void arena_reset(arena* a);
+
+/* Completely deallocates an arena, along with every block carved from it.
+
+   @param arena* the arena that we are deallocating
+   */
+void arena_free(arena* a);
+
+#endif /* ARENA_H */
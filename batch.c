@@ -0,0 +1,69 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "batch.h"
+#include "step.h"
+
+char* read_moves(const char* path) {
+  bool from_stdin = strcmp(path, "-") == 0;
+  FILE* f = from_stdin ? stdin : fopen(path, "rb");
+  if (!f) {
+    fprintf(stderr, "read_moves, unable to open %s\n", path);
+    exit(1);
+  }
+  // the size is not known up front for pipes, so the buffer doubles as it
+  // fills, and one byte is always left for the null character
+  size_t len = 0, cap = 4096;
+  char* res = (char*) malloc(cap);
+  while (res) {
+    len += fread(res + len, 1, cap - 1 - len, f);
+    if (len < cap - 1) {
+      break;
+    }
+    cap *= 2;
+    char* grown = (char*) realloc(res, cap);
+    if (!grown) {
+      free(res);
+    }
+    res = grown;
+  }
+  if (!res || ferror(f)) {
+    fprintf(stderr, "read_moves, unable to read %s\n", path);
+    exit(1);
+  }
+  res[len] = '\0';
+  if (!from_stdin) {
+    fclose(f);
+  }
+  return res;
+}
+
+int run_batch(game* g, const char* moves, bool verbose, record_writer* rec) {
+  static const char* names[] = {"in progress", "win for black",
+                                "win for white", "draw"};
+  unsigned int played = 0;
+  outcome o = game_outcome(g);
+  int status = 0;
+  for (const char* at = moves; *at && o == IN_PROGRESS; at++) {
+    if (*at == ' ' || *at == '\n' || *at == '\t' || *at == '\r') {
+      continue;
+    }
+    move m;
+    if (game_step(g, *at, &m) != STEP_PLAYED) {
+      printf("Move %u (%c) is not legal.\n", played + 1, *at);
+      status = 1;
+      break;
+    }
+    if (rec) {
+      record_move(rec, m);
+    }
+    played++;
+    o = game_outcome(g);
+    if (verbose) {
+      printf("%u %c %s\n", played, *at, names[o]);
+    }
+  }
+  game_show(g);
+  printf("Outcome: %s after %u moves\n", names[o], played);
+  return status;
+}
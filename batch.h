@@ -0,0 +1,33 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdbool.h>
+#include "logic.h"
+#include "record.h"
+
+
+/* Reads a whole file of moves until its end, which also works for pipes
+   and terminals that cannot seek.
+
+   @param char* the path of the file, or - for standard input
+   @return char* the contents of the file, ended by a null character
+   */
+char* read_moves(const char* path);
+
+/* Plays a game from a list of moves without showing the board in between,
+   then prints the final board, the outcome, and the number of moves that
+   were played. Moves are written as they are entered in the interactive
+   game (a column label, ^, or !); whitespace between them is skipped. The
+   game stops at the first illegal move, or once it is over, in which case
+   any moves left are not played. If verbose, the number, label, and
+   outcome of every move are printed as it is played.
+
+   @param game* the game that we are playing
+   @param char* the moves, ended by a null character
+   @param bool whether every move is reported
+   @param record_writer* the record the moves are appended to, or NULL
+   @return int 0 if every move was legal, otherwise 1
+   */
+int run_batch(game* g, const char* moves, bool verbose, record_writer* rec);
+
+#endif /* BATCH_H */
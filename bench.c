@@ -0,0 +1,320 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include "logic.h"
+#include "board.h"
+#include "pos.h"
+#include "timer.h"
+
+/* The number of cell operations each timed repetition aims for, so that
+   small and large boards take a similar amount of time to measure. */
+#define BENCH_TARGET_OPS 2000000ULL
+
+/* A benchmark of one primitive. It runs the primitive on a board of the given
+   size and type, and returns the seconds spent inside the timed sections,
+   storing the number of operations those sections performed. */
+typedef double (*bench_fn)(unsigned int h, unsigned int w, enum type t,
+                           unsigned long long* ops);
+
+
+struct bench {
+    const char* name;
+    bench_fn fn;
+};
+
+typedef struct bench bench;
+
+
+struct size {
+    unsigned int h, w;
+};
+
+typedef struct size size;
+
+// read by every benchmark so that the compiler cannot drop the calls
+volatile unsigned long long sink;
+
+/* Finds how many times a piece of work that touches a number of cells
+   should be repeated to reach the target number of operations.
+
+   @param unsigned long long the number of cells touched by one round
+   @return unsigned long long the number of rounds, at least one
+   */
+unsigned long long rounds(unsigned long long cells) {
+  unsigned long long n = BENCH_TARGET_OPS / (cells ? cells : 1);
+  return n ? n : 1;
+}
+
+/* Fills a board with an alternating pattern of pieces, leaving every third
+   cell empty, without going through the game rules.
+
+   @param board* the board that we are filling
+   */
+void fill_pattern(board* b) {
+  for (unsigned int r = 0; r < b->height; r++) {
+    for (unsigned int c = 0; c < b->width; c++) {
+      unsigned int i = r * b->width + c;
+      board_set(b, make_pos(r, c), i % 3 == 0 ? EMPTY :
+                                     (i % 3 == 1 ? BLACK : WHITE));
+    }
+  }
+}
+
+/* Drops pieces into a new game, sweeping the columns from left to right,
+   until a given number of pieces are on the board.
+
+   @param game* the game that we are filling
+   @param unsigned long long the number of pieces to drop
+   */
+void fill_game(game* g, unsigned long long pieces) {
+  unsigned int c = 0;
+  for (unsigned long long i = 0; i < pieces; i++) {
+    while (!drop_piece(g, c)) {
+      c = (c + 1) % g->b->width;
+    }
+    // skipping a column now and then keeps the colours from lining up
+    c = (c + 1 + (i % 5 == 0)) % g->b->width;
+  }
+}
+
+/* Reads every cell of a patterned board, over and over. */
+double bench_board_get(unsigned int h, unsigned int w, enum type t,
+                       unsigned long long* ops) {
+  board* b = board_new(w, h, t);
+  fill_pattern(b);
+  unsigned long long n = rounds((unsigned long long) w * h), sum = 0;
+  double start = now();
+  for (unsigned long long k = 0; k < n; k++) {
+    for (unsigned int r = 0; r < h; r++) {
+      for (unsigned int c = 0; c < w; c++) {
+        sum += board_get(b, make_pos(r, c));
+      }
+    }
+  }
+  double secs = now() - start;
+  sink = sum;
+  *ops = n * w * h;
+  board_free(b);
+  return secs;
+}
+
+/* Writes every cell of a board, switching colour on each pass. */
+double bench_board_set(unsigned int h, unsigned int w, enum type t,
+                       unsigned long long* ops) {
+  board* b = board_new(w, h, t);
+  unsigned long long n = rounds((unsigned long long) w * h);
+  double start = now();
+  for (unsigned long long k = 0; k < n; k++) {
+    cell colour = k % 2 ? WHITE : BLACK;
+    for (unsigned int r = 0; r < h; r++) {
+      for (unsigned int c = 0; c < w; c++) {
+        board_set(b, make_pos(r, c), colour);
+      }
+    }
+  }
+  double secs = now() - start;
+  sink = b->key;
+  *ops = n * w * h;
+  board_free(b);
+  return secs;
+}
+
+/* Fills new games one row of drops at a time; only the drops are timed. */
+double bench_drop_piece(unsigned int h, unsigned int w, enum type t,
+                        unsigned long long* ops) {
+  unsigned long long cells = (unsigned long long) w * h;
+  unsigned long long n = rounds(cells);
+  double secs = 0;
+  for (unsigned long long k = 0; k < n; k++) {
+    game* g = new_game(1, w, h, t);
+    double start = now();
+    for (unsigned int r = 0; r < h; r++) {
+      for (unsigned int c = 0; c < w; c++) {
+        drop_piece(g, c);
+      }
+    }
+    secs += now() - start;
+    game_free(g);
+  }
+  *ops = n * cells;
+  return secs;
+}
+
+/* Flips a half full game over and over. */
+double bench_disarray(unsigned int h, unsigned int w, enum type t,
+                      unsigned long long* ops) {
+  game* g = new_game(1, w, h, t);
+  unsigned long long cells = (unsigned long long) w * h;
+  fill_game(g, cells / 2);
+  unsigned long long n = rounds(cells);
+  double start = now();
+  for (unsigned long long k = 0; k < n; k++) {
+    disarray(g);
+  }
+  double secs = now() - start;
+  sink = g->player;
+  *ops = n;
+  game_free(g);
+  return secs;
+}
+
+/* Flips a half full game over and over with lazy disarray, which only marks
+   the columns it flips. */
+double bench_disarray_lazy(unsigned int h, unsigned int w, enum type t,
+                           unsigned long long* ops) {
+  game* g = new_game(1, w, h, t);
+  unsigned long long cells = (unsigned long long) w * h;
+  fill_game(g, cells / 2);
+  game_set_lazy(g, true);
+  unsigned long long n = rounds(cells);
+  double start = now();
+  for (unsigned long long k = 0; k < n; k++) {
+    disarray(g);
+  }
+  double secs = now() - start;
+  sink = g->player;
+  *ops = n;
+  game_free(g);
+  return secs;
+}
+
+/* Fills new games, then offsets until a player has no pieces left; only
+   the offsets are timed. */
+double bench_offset(unsigned int h, unsigned int w, enum type t,
+                    unsigned long long* ops) {
+  unsigned long long cells = (unsigned long long) w * h;
+  unsigned long long n = rounds(cells * cells / 2), count = 0;
+  double secs = 0;
+  for (unsigned long long k = 0; k < n; k++) {
+    game* g = new_game(1, w, h, t);
+    fill_game(g, cells);
+    double start = now();
+    while (offset(g)) {
+      count++;
+    }
+    secs += now() - start;
+    game_free(g);
+  }
+  *ops = count;
+  return secs;
+}
+
+/* Rescans a half full game from scratch over and over. */
+double bench_game_outcome(unsigned int h, unsigned int w, enum type t,
+                          unsigned long long* ops) {
+  game* g = new_game(h < w ? w : h, w, h, t);
+  unsigned long long cells = (unsigned long long) w * h;
+  fill_game(g, cells / 2);
+  unsigned long long n = rounds(cells), sum = 0;
+  double start = now();
+  for (unsigned long long k = 0; k < n; k++) {
+    game_invalidate(g);
+    sum += game_outcome(g);
+  }
+  double secs = now() - start;
+  sink = sum;
+  *ops = n;
+  game_free(g);
+  return secs;
+}
+
+/* Orders two doubles for qsort. */
+int compare_doubles(const void* a, const void* b) {
+  double x = *(const double*) a, y = *(const double*) b;
+  return (x > y) - (x < y);
+}
+
+/* Times every primitive on every board type and size. Each measurement is
+   run once to warm up, then repeated -n times (5 by default); the fastest
+   and the median repetition are reported in nanoseconds per operation.
+   Results are printed as CSV, or as JSON with -j. The -q flag only runs
+   the smallest two sizes.
+
+   Notes on what an operation is: board_get and board_set touch one cell,
+   drop_piece drops one piece into a board being filled, disarray flips a
+   board that is half full (disarray_lazy does so with lazy disarray),
+   offset removes one pair of pieces from a board that started full, and
+   game_outcome scans a half-full board from scratch (the run length is set
+   so no run is ever found, so the scan is complete).
+   */
+int main(int argc, char* argv[]) {
+  unsigned int reps = 5;
+  bool json = false, quick = false;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+      reps = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-j") == 0) {
+      json = true;
+    } else if (strcmp(argv[i], "-q") == 0) {
+      quick = true;
+    } else {
+      fprintf(stderr, "usage: %s [-n REPETITIONS] [-j] [-q]\n", argv[0]);
+      exit(1);
+    }
+  }
+  if (reps < 1) {
+    fprintf(stderr, "bench, at least one repetition is required\n");
+    exit(1);
+  }
+
+  static const bench benches[] = {
+    {"board_get", bench_board_get},
+    {"board_set", bench_board_set},
+    {"drop_piece", bench_drop_piece},
+    {"disarray", bench_disarray},
+    {"disarray_lazy", bench_disarray_lazy},
+    {"offset", bench_offset},
+    {"game_outcome", bench_game_outcome}
+  };
+  static const size sizes[] = {
+    {6, 7}, {16, 16}, {8, 62}, {62, 62}, {1024, 8}, {512, 62}
+  };
+  static const char* names[] = {"matrix", "bits", "bitboard", "columns"};
+  unsigned int n_benches = sizeof(benches) / sizeof(bench);
+  unsigned int n_sizes = quick ? 2 : sizeof(sizes) / sizeof(size);
+
+  double* times = (double*) malloc(reps * sizeof(double));
+  if (!times) {
+    fprintf(stderr, "bench, unable to allocate times\n");
+    exit(1);
+  }
+
+  if (json) {
+    printf("[");
+  } else {
+    printf("benchmark,type,height,width,reps,min_ns_per_op,median_ns_per_op\n");
+  }
+  bool first = true;
+  for (unsigned int s = 0; s < n_sizes; s++) {
+    for (unsigned int t = MATRIX; t <= COLUMNS; t++) {
+      for (unsigned int i = 0; i < n_benches; i++) {
+        unsigned long long ops;
+        benches[i].fn(sizes[s].h, sizes[s].w, t, &ops);
+        for (unsigned int k = 0; k < reps; k++) {
+          double secs = benches[i].fn(sizes[s].h, sizes[s].w, t, &ops);
+          times[k] = ops ? secs * 1e9 / ops : 0;
+        }
+        qsort(times, reps, sizeof(double), compare_doubles);
+
+        if (json) {
+          printf("%s\n  {\"benchmark\": \"%s\", \"type\": \"%s\", "
+                 "\"height\": %u, \"width\": %u, \"reps\": %u, "
+                 "\"min_ns_per_op\": %.3f, \"median_ns_per_op\": %.3f}",
+                 first ? "" : ",", benches[i].name, names[t], sizes[s].h,
+                 sizes[s].w, reps, times[0], times[reps / 2]);
+        } else {
+          printf("%s,%s,%u,%u,%u,%.3f,%.3f\n", benches[i].name, names[t],
+                 sizes[s].h, sizes[s].w, reps, times[0], times[reps / 2]);
+        }
+        fflush(stdout);
+        first = false;
+      }
+    }
+  }
+  if (json) {
+    printf("\n]\n");
+  }
+  free(times);
+  return 0;
+}
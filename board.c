@@ -1,7 +1,26 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
 #include "board.h"
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MATRIX_X86 1
+#endif
+
+/* The rows of a matrix board are padded to a multiple of this many bytes, so
+   that every row starts on the same alignment. Build with 
+   -DMATRIX_ROW_ALIGN=1 to pack the rows with no padding. */
+#ifndef MATRIX_ROW_ALIGN
+#define MATRIX_ROW_ALIGN 16
+#endif
+
+/* The size of a cache line, which the cells of a matrix board are aligned
+   to. */
+#define CACHE_LINE 64
+
 /* Raises an error if the passed type is not a supported configuration.
 
    @param enum type the type that we are checking
@@ -9,78 +28,95 @@
    logging
    */
 void check_configuration(enum type type, char* function_name) {
-  if (type != MATRIX && type != BITS) {
+  if (type != MATRIX && type != BITS && type != BITBOARD && type != COLUMNS) {
     fprintf(stderr, "%s, representation is not supported\n", function_name);
     exit(1);
   }
 }
 
-board* board_new(unsigned int width, unsigned int height, enum type type) {
-  check_configuration(type, "board_new");
+/* Rounds a number up to the next multiple of another.
 
-  board* res = (board*) malloc (sizeof(board));
-  if (!res) {
-    fprintf(stderr, "board_new, unable to allocate result\n");
-    exit(1);
+   @param size_t the number that we are rounding
+   @param size_t the multiple that we are rounding up to
+   @return size_t the smallest multiple that is at least the number
+   */
+size_t round_up(size_t n, size_t multiple) {
+  return (n + multiple - 1) / multiple * multiple;
+}
+
+uint64_t cell_key(pos p, cell c) {
+  if (c == EMPTY) {
+    return 0;
   }
-  
-  res->height = height;
-  res->width = width;
-  res->type = type;
+  return pos_key(p) * (c == BLACK ? 0x9E3779B97F4A7C15ULL
+                                   : 0xC2B2AE3D27D4EB4FULL);
+}
+
+/* Finds the number of bytes the cells of a board take, along with the stride
+   of the board.
+
+   @param unsigned int the number of columns in the board
+   @param unsigned int the number of rows in the board
+   @param enum type the representation for the board
+   @param unsigned int* where the stride of the board is stored
+   @return size_t the number of bytes of cells
+   */
+size_t cell_bytes(unsigned int width, unsigned int height, enum type type,
+                  unsigned int* stride) {
+  *stride = width;
   if (type == MATRIX) {
-    res->u.matrix = (cell**) malloc (sizeof (cell*) * height);
-    if (!res->u.matrix) {
-      fprintf(stderr, "board_new, unable to allocate result\n");
-      exit(1);
-    }
-    for (unsigned int i = 0; i < height; i++) {
-      res->u.matrix[i]  = (cell*) malloc (sizeof (cell) * width);
-      if (!res->u.matrix[i]) {
-        fprintf(stderr, "board_new, unable to allocate result\n");
-        exit(1);
-      }
-      for (unsigned int j = 0; j < width; j++) {
-        res->u.matrix[i][j] = EMPTY;
-      }
-    }
+    *stride = round_up(width, MATRIX_ROW_ALIGN);
+    return round_up((size_t) *stride * height, CACHE_LINE);
   } else if (type == BITS) {
     unsigned int total_bits = width * height * 2;
-    unsigned int reslen = (total_bits + 31) / 32;
-    res->u.bits = (unsigned int*) malloc (sizeof(unsigned int) * reslen);
-    if (!res->u.bits) {
-      fprintf(stderr, "board_new, unable to allocate result\n");
-      exit(1);
-    }
-    for(unsigned int i = 0; i < reslen; i++) {
-      res->u.bits[i] = 0;
-    }
+    return sizeof(unsigned int) * ((total_bits + 31) / 32);
+  } else if (type == BITBOARD) {
+    // black's bitboard, then white's, then scratch space for run detection
+    return 3 * (size_t) plane_words(width, height) * sizeof(uint64_t);
   }
+  *stride = (2 * height + 63) / 64;
+  return (size_t) *stride * width * sizeof(uint64_t);
+}
+
+size_t board_size(unsigned int width, unsigned int height, enum type type) {
+  check_configuration(type, "board_size");
+  unsigned int stride;
+  return round_up(round_up(sizeof(board), CACHE_LINE) + 
+                  cell_bytes(width, height, type, &stride), CACHE_LINE);
+}
+
+board* board_place(void* block, unsigned int width, unsigned int height,
+                   enum type type) {
+  check_configuration(type, "board_place");
 
+  board* res = (board*) block;
+  res->height = height;
+  res->width = width;
+  res->type = type;
+  res->key = 0;
+  size_t bytes = cell_bytes(width, height, type, &res->stride);
+  // the cells start on the first cache line after the struct
+  res->u.matrix = (uint8_t*) block + round_up(sizeof(board), CACHE_LINE);
+  memset(res->u.matrix, 0, bytes);
   return res;
 }
 
-void board_free(board* b){
-  check_configuration(b->type, "board_free");
-  
-  if (b->type == MATRIX) {
-    for (unsigned int r = 0; r < b->height; r++) {
-      free(b->u.matrix[r]);
-    }
-    free(b->u.matrix);
-  } else if (b->type == BITS) {
-    free(b->u.bits);
+board* board_new(unsigned int width, unsigned int height, enum type type) {
+  check_configuration(type, "board_new");
+
+  void* block = aligned_alloc(CACHE_LINE, board_size(width, height, type));
+  if (!block) {
+    fprintf(stderr, "board_new, unable to allocate result\n");
+    exit(1);
   }
+  return board_place(block, width, height, type);
+}
 
+void board_free(board* b){
+  check_configuration(b->type, "board_free");
   free(b);
 }
 
-/* Determines the label that will be displayed for either a row or column.
-   The lables follow the specifications stated in the description of the 
-   board_show function: the digits 0-9, the capital letters A-Z, the lower
-   case letters a-z, then '?'.
-
-   @param unsinged int the row or column that we are finding the label for
-   */
 char find_label(unsigned int l) {
   if (l < 10) {
     return '0' + l;
@@ -94,32 +130,146 @@ char find_label(unsigned int l) {
   return '?';
 }
 
-void board_show(board* b){
-  check_configuration(b->type, "board_show");
+/* Writes a whole buffer to a file descriptor, however many calls it takes.
+
+   @param int the file descriptor
+   @param char* the buffer
+   @param size_t the number of bytes to write
+   */
+void write_out(int fd, const char* buffer, size_t n) {
+  while (n > 0) {
+    ssize_t done = write(fd, buffer, n);
+    if (done < 0 && errno == EINTR) {
+      continue;
+    }
+    if (done <= 0) {
+      return;
+    }
+    buffer += done;
+    n -= (size_t) done;
+  }
+}
 
-  printf("  ");
+/* Finds the character a cell is displayed with.
+
+   @param cell the cell
+   @return char '.', '*', or 'o'
+   */
+char cell_char(cell c) {
+  return c == EMPTY ? '.' : c == BLACK ? '*' : 'o';
+}
+
+size_t board_render_size(unsigned int width, unsigned int height) {
+  return (size_t) (width + 3) * (height + 1);
+}
+
+size_t board_render(board* b, char* out) {
+  check_configuration(b->type, "board_render");
+  char* at = out;
+  *at++ = ' ';
+  *at++ = ' ';
   for (unsigned int c = 0; c < b->width; c++) {
-    printf("%c", find_label(c));
+    *at++ = find_label(c);
   }
-  printf("\n");
+  *at++ = '\n';
 
   for (unsigned int r = 0; r < b->height; r++) {
-    printf("%c ", find_label(r));
-    for(unsigned int c = 0; c < b->width; c++) {
-      switch (board_get(b, make_pos(r, c))) {
-        case EMPTY:
-          printf(".");
-          break;
-        case BLACK:
-          printf("*");
-          break;
-        case WHITE:
-          printf("o");
-          break;
+    *at++ = find_label(r);
+    *at++ = ' ';
+    for (unsigned int c = 0; c < b->width; c++) {
+      *at++ = cell_char(board_get_unchecked(b, make_pos(r, c)));
+    }
+    *at++ = '\n';
+  }
+  return (size_t) (at - out);
+}
+
+void board_show(board* b){
+  // the buffer is kept for the next call, and only grows
+  static char* buffer = NULL;
+  static size_t cap = 0;
+  size_t need = board_render_size(b->width, b->height);
+  if (need > cap) {
+    char* grown = (char*) realloc(buffer, need);
+    if (!grown) {
+      fprintf(stderr, "board_show, unable to allocate buffer\n");
+      exit(1);
+    }
+    buffer = grown;
+    cap = need;
+  }
+  size_t n = board_render(b, buffer);
+  fflush(stdout);
+  write_out(STDOUT_FILENO, buffer, n);
+}
+
+board_view* board_view_new(unsigned int width, unsigned int height, int fd) {
+  board_view* res = (board_view*) malloc(sizeof(board_view));
+  if (!res) {
+    fprintf(stderr, "board_view_new, unable to allocate result\n");
+    exit(1);
+  }
+  res->width = width;
+  res->height = height;
+  res->fd = fd;
+  res->drawn = false;
+  res->frame = (char*) malloc((size_t) width * height);
+  // the largest frame moves the cursor to every cell; a move takes at most
+  // 2 + 10 + 1 + 10 + 1 bytes
+  res->out_cap = 32 + board_render_size(width, height) +
+                   (size_t) width * height * 25;
+  res->out = (char*) malloc(res->out_cap);
+  if (!res->frame || !res->out) {
+    fprintf(stderr, "board_view_new, unable to allocate buffers\n");
+    exit(1);
+  }
+  return res;
+}
+
+void board_view_free(board_view* v) {
+  free(v->frame);
+  free(v->out);
+  free(v);
+}
+
+void board_view_draw(board_view* v, board* b) {
+  if (b->width != v->width || b->height != v->height) {
+    fprintf(stderr, "board_view_draw, board does not match the view\n");
+    exit(1);
+  }
+  char* at = v->out;
+  if (!v->drawn) {
+    at += sprintf(at, "\x1b[2J\x1b[H");
+    at += board_render(b, at);
+    for (unsigned int r = 0; r < b->height; r++) {
+      for (unsigned int c = 0; c < b->width; c++) {
+        v->frame[r * b->width + c] = 
+          cell_char(board_get_unchecked(b, make_pos(r, c)));
+      }
+    }
+    v->drawn = true;
+  } else {
+    for (unsigned int r = 0; r < b->height; r++) {
+      // the cursor is only moved when the last cell drawn is not just
+      // to the left
+      unsigned int next = b->width;
+      for (unsigned int c = 0; c < b->width; c++) {
+        char x = cell_char(board_get_unchecked(b, make_pos(r, c)));
+        if (v->frame[r * b->width + c] == x) {
+          continue;
+        }
+        v->frame[r * b->width + c] = x;
+        if (c != next) {
+          // the header takes the first line and a row label two columns
+          at += sprintf(at, "\x1b[%u;%uH", r + 2, c + 3);
+        }
+        *at++ = x;
+        next = c + 1;
       }
     }
-    printf("\n");
   }
+  at += sprintf(at, "\x1b[%u;1H\x1b[J", b->height + 2);
+  write_out(v->fd, v->out, (size_t) (at - v->out));
 }
 
 
@@ -130,14 +280,7 @@ cell board_get(board* b, pos p) {
         "board\n");
     exit(1);
   } 
-  if (b->type == MATRIX) {
-    return b->u.matrix[p.r][p.c];
-  } else if (b->type == BITS) {
-    unsigned int bit_index = (p.r * b->width + p.c) * 2;
-    unsigned int arr_index = bit_index / 32;
-    return (cell) ((b->u.bits[arr_index] >> (bit_index % 32)) & 0x3);
-  }  
-  return -1; //nonsense, just to return someting, but should never be reached
+  return board_get_unchecked(b, p);
 }
 
 
@@ -147,16 +290,577 @@ void board_set(board* b, pos p, cell c) {
     fprintf(stderr, "board_set, position is not within the board boundary\n");
     exit(1);
   }
+  board_set_unchecked(b, p, c);
+}
+
+/* Flips bits of a word in place with an atomic exclusive-or, so that threads
+   changing other bits of the same word do not lose each other's updates.
+
+   @param unsigned int* the word being changed
+   @param unsigned int the bits to flip
+   */
+void atomic_flip(unsigned int* word, unsigned int bits) {
+  if (bits) {
+    __atomic_fetch_xor(word, bits, __ATOMIC_RELAXED);
+  }
+}
+
+/* Flips bits of a 64 bit word in place with an atomic exclusive-or.
+
+   @param uint64_t* the word being changed
+   @param uint64_t the bits to flip
+   */
+void atomic_flip64(uint64_t* word, uint64_t bits) {
+  if (bits) {
+    __atomic_fetch_xor(word, bits, __ATOMIC_RELAXED);
+  }
+}
+
+void board_swap(board* b, pos p1, pos p2) {
+  check_configuration(b->type, "board_swap");
+  if (p1.r >= b->height || p1.c >= b->width ||
+      p2.r >= b->height || p2.c >= b->width) {
+    fprintf(stderr, "board_swap, position is not within the board boundary\n");
+    exit(1);
+  }
+  cell c1 = EMPTY, c2 = EMPTY;
   if (b->type == MATRIX) {
-    b->u.matrix[p.r][p.c] = c;
+    uint8_t* m1 = &b->u.matrix[(size_t) p1.r * b->stride + p1.c];
+    uint8_t* m2 = &b->u.matrix[(size_t) p2.r * b->stride + p2.c];
+    c1 = (cell) *m1;
+    c2 = (cell) *m2;
+    *m1 = (uint8_t) c2;
+    *m2 = (uint8_t) c1;
   } else if (b->type == BITS) {
-    unsigned int bit_index = (p.r * b->width + p.c) * 2;
-    unsigned int arr_index = bit_index / 32;
-    unsigned int offset = bit_index % 32;
+    unsigned int i1 = (p1.r * b->width + p1.c) * 2;
+    unsigned int i2 = (p2.r * b->width + p2.c) * 2;
+    unsigned int* w1 = &b->u.bits[i1 / 32];
+    unsigned int* w2 = &b->u.bits[i2 / 32];
+    unsigned int v1 =
+        (__atomic_load_n(w1, __ATOMIC_RELAXED) >> (i1 % 32)) & 0x3;
+    unsigned int v2 =
+        (__atomic_load_n(w2, __ATOMIC_RELAXED) >> (i2 % 32)) & 0x3;
+    atomic_flip(w1, (v1 ^ v2) << (i1 % 32));
+    atomic_flip(w2, (v1 ^ v2) << (i2 % 32));
+    c1 = (cell) v1;
+    c2 = (cell) v2;
+  } else if (b->type == BITBOARD) {
+    unsigned int words = plane_words(b->width, b->height);
+    uint64_t i1 = plane_index(b, p1), i2 = plane_index(b, p2);
+    for (unsigned int k = 0; k < 2; k++) {
+      uint64_t* plane = b->u.planes + k * words;
+      uint64_t v1 = (__atomic_load_n(&plane[i1 / 64], __ATOMIC_RELAXED) 
+                       >> (i1 % 64)) & 1;
+      uint64_t v2 = (__atomic_load_n(&plane[i2 / 64], __ATOMIC_RELAXED) 
+                       >> (i2 % 64)) & 1;
+      atomic_flip64(&plane[i1 / 64], (v1 ^ v2) << (i1 % 64));
+      atomic_flip64(&plane[i2 / 64], (v1 ^ v2) << (i2 % 64));
+      c1 = v1 ? (k == 0 ? BLACK : WHITE) : c1;
+      c2 = v2 ? (k == 0 ? BLACK : WHITE) : c2;
+    }
+  } else if (b->type == COLUMNS) {
+    // columns never share words, so only swaps within one column share a
+    // word, and those are never run at the same time
+    c1 = board_get_unchecked(b, p1);
+    c2 = board_get_unchecked(b, p2);
+    uint64_t i1 = column_index(b, p1), i2 = column_index(b, p2);
+    b->u.columns[i1 / 64] ^= (uint64_t) (c1 ^ c2) << (i1 % 64);
+    b->u.columns[i2 / 64] ^= (uint64_t) (c1 ^ c2) << (i2 % 64);
+  }
+  if (c1 != c2) {
+    atomic_flip64(&b->key, cell_key(p1, c1) ^ cell_key(p1, c2) ^
+                           cell_key(p2, c2) ^ cell_key(p2, c1));
+  }
+}
+
+/* Reverses the order of the pairs of bits in a word.
+
+   @param uint64_t the word that we are reversing
+   @return uint64_t the word with pair i moved to pair 31 - i
+   */
+uint64_t reverse_pairs(uint64_t x) {
+  x = ((x >> 2) & 0x3333333333333333ULL) | ((x & 0x3333333333333333ULL) << 2);
+  x = ((x >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((x & 0x0F0F0F0F0F0F0F0FULL) << 4);
+  return __builtin_bswap64(x);
+}
+
+/* Finds the change in the key of a board when the cells in rows lo through
+   hi of a column are each moved by a number of rows. The cells are read
+   before they move.
+
+   @param board* the board that we are changing
+   @param unsigned int the column of the cells
+   @param unsigned int the first row that moves
+   @param unsigned int the last row that moves
+   @param int the number of rows each cell moves, down being positive
+   @return uint64_t the value to exclusive-or into the key
+   */
+uint64_t moved_key(board* b, unsigned int c, unsigned int lo, 
+                   unsigned int hi, int by) {
+  uint64_t delta = 0;
+  for (unsigned int r = lo; r <= hi && r < b->height; r++) {
+    cell cur = board_get_unchecked(b, make_pos(r, c));
+    if (cur != EMPTY) {
+      delta ^= cell_key(make_pos(r, c), cur) ^ 
+                 cell_key(make_pos(r + by, c), cur);
+    }
+  }
+  return delta;
+}
+
+void board_reverse_column(board* b, unsigned int c, unsigned int count) {
+  check_configuration(b->type, "board_reverse_column");
+  if (c >= b->width || count > b->height) {
+    fprintf(stderr, "board_reverse_column, column is not within the board "
+            "boundary\n");
+    exit(1);
+  }
+  unsigned int top = b->height - count;
+  if (b->type != COLUMNS || count < 2) {
+    for (unsigned int i = 0; i < count / 2; i++) {
+      board_swap(b, make_pos(top + i, c), make_pos(b->height - 1 - i, c));
+    }
+    return;
+  }
 
-    //clear previous value
-    b->u.bits[arr_index] &= ~(0x3 << offset);
-    //write new value
-    b->u.bits[arr_index] |= ((unsigned int) c << offset);
+  uint64_t delta = 0;
+  for (unsigned int i = 0; i < count / 2; i++) {
+    pos p1 = make_pos(top + i, c), p2 = make_pos(b->height - 1 - i, c);
+    cell c1 = board_get_unchecked(b, p1), c2 = board_get_unchecked(b, p2);
+    if (c1 != c2) {
+      delta ^= cell_key(p1, c1) ^ cell_key(p1, c2) ^ 
+                 cell_key(p2, c2) ^ cell_key(p2, c1);
+    }
+  }
+  // the field of the stack spans the lowest words of the column: reversing
+  // the order of those words and the pairs in each leaves the field at the
+  // top of the last word, and a shift across the words moves it back down
+  uint64_t* word = &b->u.columns[(size_t) c * b->stride];
+  unsigned int words = (2 * count + 63) / 64;
+  unsigned int shift = 64 * words - 2 * count;
+  uint64_t above = shift == 0 ? 0 
+                              : word[words - 1] & ~(~(uint64_t) 0 >> shift);
+  for (unsigned int i = 0; i < (words + 1) / 2; i++) {
+    uint64_t low = word[i];
+    word[i] = reverse_pairs(word[words - 1 - i]);
+    word[words - 1 - i] = reverse_pairs(low);
+  }
+  if (shift != 0) {
+    for (unsigned int i = 0; i < words; i++) {
+      uint64_t next = i + 1 < words ? word[i + 1] << (64 - shift) : 0;
+      word[i] = (word[i] >> shift) | next;
+    }
+  }
+  word[words - 1] |= above;
+  atomic_flip64(&b->key, delta);
+}
+
+void board_fall(board* b, pos p, unsigned int top) {
+  check_configuration(b->type, "board_fall");
+  if (p.r >= b->height || p.c >= b->width || top > p.r) {
+    fprintf(stderr, "board_fall, position is not within the board "
+            "boundary\n");
+    exit(1);
+  }
+  if (b->type != COLUMNS) {
+    for (unsigned int r = p.r; r > top; r--) {
+      cell above = board_get_unchecked(b, make_pos(r-1, p.c));
+      board_set_unchecked(b, make_pos(r, p.c), above);
+    }
+    board_set_unchecked(b, make_pos(top, p.c), EMPTY);
+    return;
+  }
+
+  b->key ^= cell_key(p, board_get_unchecked(b, p));
+  if (p.r > 0) {
+    b->key ^= moved_key(b, p.c, top, p.r - 1, 1);
+  }
+  // the cells from the emptied one up to the top move down one pair, with
+  // each word taking the lowest pair of the word above, up to the word of
+  // the top cell, which is left empty
+  uint64_t* word = &b->u.columns[(size_t) p.c * b->stride];
+  unsigned int low = 2 * (b->height - 1 - p.r);
+  unsigned int lo = low / 64, hi = 2 * (b->height - 1 - top) / 64;
+  uint64_t below = ((uint64_t) 1 << (low % 64)) - 1;
+  uint64_t kept = word[lo] & below;
+  for (unsigned int i = lo; i <= hi; i++) {
+    uint64_t next = i < hi ? word[i + 1] << 62 : 0;
+    word[i] = (word[i] >> 2) | next;
+  }
+  word[lo] = (word[lo] & ~below) | kept;
+}
+
+void board_rise(board* b, pos p, unsigned int top, cell c) {
+  check_configuration(b->type, "board_rise");
+  if (p.r >= b->height || p.c >= b->width || top > p.r + 1 || top == 0) {
+    fprintf(stderr, "board_rise, position is not within the board "
+            "boundary\n");
+    exit(1);
+  }
+  if (b->type != COLUMNS) {
+    for (unsigned int r = top; r <= p.r; r++) {
+      cell below = board_get_unchecked(b, make_pos(r, p.c));
+      board_set_unchecked(b, make_pos(r-1, p.c), below);
+    }
+    board_set_unchecked(b, p, c);
+    return;
+  }
+
+  b->key ^= moved_key(b, p.c, top, p.r, -1) ^ cell_key(p, c);
+  // the cells from the filled one up to the top move up one pair, from the
+  // word the top cell moves into down to the word of the filled cell
+  uint64_t* word = &b->u.columns[(size_t) p.c * b->stride];
+  unsigned int low = 2 * (b->height - 1 - p.r);
+  unsigned int lo = low / 64, hi = 2 * (b->height - top) / 64;
+  uint64_t below = ((uint64_t) 1 << (low % 64)) - 1;
+  for (unsigned int i = hi; i > lo; i--) {
+    word[i] = (word[i] << 2) | (word[i - 1] >> 62);
+  }
+  word[lo] = (word[lo] & below) | ((word[lo] & ~below) << 2) | 
+               ((uint64_t) c << (low % 64));
+}
+
+/* Narrows a multi-word bitboard in place so that only the bits starting a
+   longer stretch survive: every bit i is ANDed with bit i + shift. Words are
+   visited from lowest to highest, so each word only reads words that have not
+   been rewritten yet.
+
+   @param uint64_t* the bitboard being narrowed
+   @param unsigned int the number of words in the bitboard
+   @param uint64_t the distance, in bits, to the bit each bit is ANDed with
+   */
+void planes_shift_and(uint64_t* m, unsigned int words, uint64_t shift) {
+  uint64_t skip = shift / 64;
+  unsigned int s = shift % 64;
+  for (unsigned int i = 0; i < words; i++) {
+    uint64_t lo = (i + skip < words) ? m[i + skip] : 0;
+    uint64_t hi = (i + skip + 1 < words) ? m[i + skip + 1] : 0;
+    uint64_t shifted = s == 0 ? lo : (lo >> s) | (hi << (64 - s));
+    m[i] &= shifted;
+  }
+}
+
+/* Checks a single direction for a run on a bitboard of one word. Doubles the
+   length of the stretch each bit stands for until the run length is reached,
+   so a run of length n takes about log2(n) shifts.
+
+   @param uint64_t the player's bitboard
+   @param unsigned int the distance in bits between neighbouring cells in the
+   direction we are checking
+   @param unsigned int the run length
+   @return bool if a run was found in that direction
+   */
+bool word_has_run(uint64_t x, unsigned int dir, unsigned int run) {
+  unsigned int len = 1;
+  while (x && 2 * len <= run) {
+    x = (len * dir < 64) ? x & (x >> (len * dir)) : 0;
+    len *= 2;
+  }
+  if (x && len < run) {
+    x = ((run - len) * dir < 64) ? x & (x >> ((run - len) * dir)) : 0;
+  }
+  return x != 0;
+}
+
+bool bitboard_has_run(board* b, cell player, unsigned int run) {
+  if (b->type != BITBOARD || (player != BLACK && player != WHITE)) {
+    fprintf(stderr, "bitboard_has_run, board is not a bitboard\n");
+    exit(1);
+  }
+  unsigned int words = plane_words(b->width, b->height);
+  uint64_t* plane = b->u.planes + (player == BLACK ? 0 : words);
+  unsigned int dirs[4] = {1, b->height + 1, b->height, b->height + 2};
+
+  if (words == 1) {
+    for (unsigned int d = 0; d < 4; d++) {
+      if (word_has_run(plane[0], dirs[d], run)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  uint64_t* m = b->u.planes + 2 * words;
+  for (unsigned int d = 0; d < 4; d++) {
+    bool any = false;
+    for (unsigned int i = 0; i < words; i++) {
+      m[i] = plane[i];
+      any = any || m[i];
+    }
+    unsigned int len = 1;
+    while (any && 2 * len <= run) {
+      planes_shift_and(m, words, (uint64_t) len * dirs[d]);
+      len *= 2;
+      any = false;
+      for (unsigned int i = 0; i < words && !any; i++) {
+        any = m[i] != 0;
+      }
+    }
+    if (any && len < run) {
+      planes_shift_and(m, words, (uint64_t) (run - len) * dirs[d]);
+      any = false;
+      for (unsigned int i = 0; i < words && !any; i++) {
+        any = m[i] != 0;
+      }
+    }
+    if (any) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool bitboard_full(board* b) {
+  if (b->type != BITBOARD) {
+    fprintf(stderr, "bitboard_full, board is not a bitboard\n");
+    exit(1);
+  }
+  unsigned int words = plane_words(b->width, b->height);
+  uint64_t count = 0;
+  for (unsigned int i = 0; i < words; i++) {
+    count += __builtin_popcountll(b->u.planes[i] | b->u.planes[words + i]);
+  }
+  return count == (uint64_t) b->width * b->height;
+}
+
+/* Builds the mask of the cells of one row of a matrix board that hold a
+   given value: bit c is set when column c holds it. Every kernel reads the
+   row in blocks that stay within the stride, and compares the cells left
+   over one at a time. */
+typedef uint64_t (*row_mask_fn)(const uint8_t* row, unsigned int width, 
+                                unsigned int stride, uint8_t value);
+
+/* Builds a row mask one cell at a time.
+
+   @param uint8_t* the first cell of the row
+   @param unsigned int the number of columns, at most 64
+   @param unsigned int the distance between the starts of two rows, unused
+   here since no cell past the width is read
+   @param uint8_t the value of the cells we are looking for
+   @return uint64_t the mask of the cells that hold the value
+   */
+uint64_t row_mask_scalar(const uint8_t* row, unsigned int width, 
+                         unsigned int stride, uint8_t value) {
+  (void) stride;
+  uint64_t mask = 0;
+  for (unsigned int c = 0; c < width; c++) {
+    mask |= (uint64_t) (row[c] == value) << c;
+  }
+  return mask;
+}
+
+#ifdef MATRIX_X86
+/* Builds a row mask 16 cells at a time with SSE2.
+
+   @param uint8_t* the first cell of the row
+   @param unsigned int the number of columns, at most 64
+   @param unsigned int the distance between the starts of two rows
+   @param uint8_t the value of the cells we are looking for
+   @return uint64_t the mask of the cells that hold the value
+   */
+__attribute__((target("sse2")))
+uint64_t row_mask_sse2(const uint8_t* row, unsigned int width, 
+                       unsigned int stride, uint8_t value) {
+  __m128i want = _mm_set1_epi8((char) value);
+  uint64_t mask = 0;
+  unsigned int c = 0;
+  for (; c < width && c + 16 <= stride; c += 16) {
+    __m128i cells = _mm_loadu_si128((const __m128i*) (row + c));
+    uint64_t bits = (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(cells, want));
+    mask |= bits << c;
+  }
+  for (; c < width; c++) {
+    mask |= (uint64_t) (row[c] == value) << c;
+  }
+  return width == 64 ? mask : mask & (((uint64_t) 1 << width) - 1);
+}
+
+/* Builds a row mask 32 cells at a time with AVX2.
+
+   @param uint8_t* the first cell of the row
+   @param unsigned int the number of columns, at most 64
+   @param unsigned int the distance between the starts of two rows
+   @param uint8_t the value of the cells we are looking for
+   @return uint64_t the mask of the cells that hold the value
+   */
+__attribute__((target("avx2")))
+uint64_t row_mask_avx2(const uint8_t* row, unsigned int width, 
+                       unsigned int stride, uint8_t value) {
+  __m256i want = _mm256_set1_epi8((char) value);
+  uint64_t mask = 0;
+  unsigned int c = 0;
+  for (; c < width && c + 32 <= stride; c += 32) {
+    __m256i cells = _mm256_loadu_si256((const __m256i*) (row + c));
+    uint64_t bits = (uint32_t) _mm256_movemask_epi8(
+                                 _mm256_cmpeq_epi8(cells, want));
+    mask |= bits << c;
+  }
+  if (c < width && c + 16 <= stride) {
+    __m128i cells = _mm_loadu_si128((const __m128i*) (row + c));
+    uint64_t bits = (uint16_t) _mm_movemask_epi8(
+                      _mm_cmpeq_epi8(cells, _mm_set1_epi8((char) value)));
+    mask |= bits << c;
+    c += 16;
+  }
+  for (; c < width; c++) {
+    mask |= (uint64_t) (row[c] == value) << c;
+  }
+  return width == 64 ? mask : mask & (((uint64_t) 1 << width) - 1);
+}
+#endif
+
+// the kernel chosen by matrix_simd, or NULL before the first choice
+row_mask_fn chosen_row_mask = NULL;
+simd_level chosen_level = SIMD_SCALAR;
+
+simd_level matrix_simd(simd_level level) {
+  row_mask_fn fn = row_mask_scalar;
+  simd_level used = SIMD_SCALAR;
+#ifdef MATRIX_X86
+  __builtin_cpu_init();
+  if (level >= SIMD_AVX2 && __builtin_cpu_supports("avx2")) {
+    fn = row_mask_avx2;
+    used = SIMD_AVX2;
+  } else if (level >= SIMD_SSE2 && __builtin_cpu_supports("sse2")) {
+    fn = row_mask_sse2;
+    used = SIMD_SSE2;
+  }
+#endif
+  __atomic_store_n(&chosen_level, used, __ATOMIC_RELAXED);
+  __atomic_store_n(&chosen_row_mask, fn, __ATOMIC_RELEASE);
+  return used;
+}
+
+/* Finds the row mask kernel in use, choosing the best one the processor
+   supports if none has been chosen yet.
+
+   @return row_mask_fn the kernel that builds row masks
+   */
+row_mask_fn row_mask_kernel() {
+  row_mask_fn fn = __atomic_load_n(&chosen_row_mask, __ATOMIC_ACQUIRE);
+  if (!fn) {
+    matrix_simd(SIMD_AVX2);
+    fn = __atomic_load_n(&chosen_row_mask, __ATOMIC_ACQUIRE);
+  }
+  return fn;
+}
+
+/* Raises an error if a board cannot be checked with row masks.
+
+   @param board* the board that we are checking
+   @param char* the function name that called the check, used for error 
+   logging
+   */
+void check_row_masks(board* b, char* function_name) {
+  if (b->type != MATRIX) {
+    fprintf(stderr, "%s, board is not a matrix\n", function_name);
+    exit(1);
+  }
+  if (b->width > 64) {
+    fprintf(stderr, "%s, board is too wide\n", function_name);
+    exit(1);
+  }
+}
+
+/* Shifts the masks of a line of rows together, so that after the call the
+   mask of row r holds the cells that start a line of a given length going
+   down from row r, moving a fixed number of columns per row. The line 
+   length is built up by doubling, so the number of passes grows with the
+   logarithm of the length.
+
+   @param uint64_t* the row masks, overwritten with the result
+   @param unsigned int the number of rows
+   @param unsigned int the length of the lines
+   @param int the columns moved per row: 0 for vertical lines, 1 for lines
+   going down to the right, and -1 for lines going down to the left
+   @return bool true if any row starts such a line
+   */
+bool masks_have_line(uint64_t* masks, unsigned int rows, unsigned int run,
+                     int dir_c) {
+  if (run > rows) {
+    return false;
+  }
+  unsigned int len = 1;
+  while (len < run) {
+    unsigned int s = len < run - len ? len : run - len;
+    for (unsigned int r = 0; r + len + s <= rows; r++) {
+      uint64_t below = masks[r + s];
+      masks[r] &= dir_c > 0 ? below >> s : (dir_c < 0 ? below << s : below);
+    }
+    len += s;
+  }
+  for (unsigned int r = 0; r + run <= rows; r++) {
+    if (masks[r]) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/* Reports if a single row mask holds a horizontal run of a given length.
+
+   @param uint64_t the row mask
+   @param unsigned int the length of the run, at most 64
+   @return bool true if the mask holds a run
+   */
+bool mask_has_run(uint64_t m, unsigned int run) {
+  unsigned int len = 1;
+  while (m && len < run) {
+    unsigned int s = len < run - len ? len : run - len;
+    m &= m >> s;
+    len += s;
+  }
+  return m != 0;
+}
+
+bool matrix_has_run(board* b, cell player, unsigned int run) {
+  check_row_masks(b, "matrix_has_run");
+  if (run == 0) {
+    return true;
+  }
+  row_mask_fn row_mask = row_mask_kernel();
+
+  // two masks per row: the masks themselves and a copy for each direction
+  uint64_t stack[2 * 128];
+  uint64_t* masks = stack;
+  if (b->height > 128) {
+    masks = (uint64_t*) malloc(2 * sizeof(uint64_t) * b->height);
+    if (!masks) {
+      fprintf(stderr, "matrix_has_run, unable to allocate masks\n");
+      exit(1);
+    }
+  }
+  uint64_t* lines = masks + b->height;
+
+  bool found = false, any = false;
+  for (unsigned int r = 0; r < b->height; r++) {
+    masks[r] = row_mask(b->u.matrix + (size_t) r * b->stride, b->width,
+                        b->stride, (uint8_t) player);
+    any = any || masks[r];
+    found = found || (run <= b->width && mask_has_run(masks[r], run));
+  }
+  for (int dir_c = -1; any && !found && dir_c <= 1; dir_c++) {
+    if (dir_c != 0 && run > b->width) {
+      continue;
+    }
+    memcpy(lines, masks, sizeof(uint64_t) * b->height);
+    found = masks_have_line(lines, b->height, run, dir_c);
+  }
+
+  if (masks != stack) {
+    free(masks);
+  }
+  return found;
+}
+
+bool matrix_full(board* b) {
+  check_row_masks(b, "matrix_full");
+  row_mask_fn row_mask = row_mask_kernel();
+  for (unsigned int r = 0; r < b->height; r++) {
+    if (row_mask(b->u.matrix + (size_t) r * b->stride, b->width, b->stride,
+                 EMPTY)) {
+      return false;
+    }
   }
+  return true;
 }
@@ -1,6 +1,9 @@
 #ifndef BOARD_H
 #define BOARD_H
 
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
 #include "pos.h"
 
 
@@ -14,30 +17,59 @@ typedef enum cell cell;
 
 
 union board_rep {
-    enum cell** matrix;
+    uint8_t* matrix;
     unsigned int* bits;
+    uint64_t* planes;
+    uint64_t* columns;
 };
 
 typedef union board_rep board_rep;
 
 enum type {
-    MATRIX, BITS
+    MATRIX, BITS, BITBOARD, COLUMNS
 };
 
 
 struct board {
     unsigned int width, height;
+    unsigned int stride;
     enum type type;
     board_rep u;
+    uint64_t key;
 };
 
 typedef struct board board;
 
-/* Creates a new, fully-empty board of a given width and height. A particular
-   type of board representation, either matrix or bits, but we will limit
-   the representation to a matrix temporarily. If a bit representation is 
-   requested, we will raise an error. Note that we mean that fully empty as
-   a 2d array of cells that are set to the state EMPTY.
+/* Finds the Zobrist key of a piece at a given position. The key of a board 
+   is the exclusive-or of the keys of all of its pieces, and it is kept up to
+   date by board_set and board_swap, so that it never has to be recomputed
+   from the cells. An empty cell has the key 0.
+
+   @param pos the position of the piece
+   @param cell the piece at that position
+   @return uint64_t the key of the piece
+   */
+uint64_t cell_key(pos p, cell c);
+
+/* Creates a new, fully empty board of a given width and height, that is, a
+   board whose cells are all set to the state EMPTY. The board uses one of
+   four representations: matrix, bits, bitboard, or columns. The matrix
+   representation is a single cache line aligned block of one byte cells,
+   stored row after row: the cell at row r and column c is
+   matrix[r * stride + c]. The stride is the width rounded up to a multiple
+   of MATRIX_ROW_ALIGN bytes (16 unless the build defines it otherwise), and
+   the padding at the end of each row is always EMPTY. The bits
+   representation packs two bit cells row after row into 32 bit words. The
+   bitboard representation keeps one bitboard per player in a padded-column
+   layout: column c occupies bits c * (height + 1) through
+   c * (height + 1) + height, with the bottom row in the lowest bit and the
+   top bit of every column left empty as a separator. Boards of up to 64
+   padded cells fit in a single word per player; larger boards use as many
+   words as needed. The columns representation packs two bit cells column by
+   column: each column starts on a fresh 64 bit word and takes stride words,
+   with the bottom row in the lowest two bits, so the pieces of a column form
+   one contiguous field and no two columns share a word. The bits and
+   bitboard representations set the stride to the width.
 
    @param unsigned int the number of columns in the board
    @param unsigned int the number of rows in the board
@@ -46,6 +78,34 @@ typedef struct board board;
    */
 board* board_new(unsigned int width, unsigned int height, enum type type);
 
+/* Finds the number of bytes needed to hold a board and its cells in one
+   block, as board_place lays them out. The size is a multiple of the size of
+   a cache line.
+
+   @param unsigned int the number of columns in the board
+   @param unsigned int the number of rows in the board
+   @param enum type the representation for the board
+   @return size_t the number of bytes the board takes
+   */
+size_t board_size(unsigned int width, unsigned int height, enum type type);
+
+/* Creates a fully empty board, like board_new, in a block of memory owned by
+   the caller. The block must be aligned to a cache line and hold at least
+   board_size bytes. The board struct is placed at the start of the block,
+   and its cells start at the next cache line, so a board placed this way 
+   can be copied to another block with memcpy, as long as the pointer to its
+   cells is moved along. board_new places boards in blocks of their own, 
+   and board_free must only be called on those.
+
+   @param void* the block that holds the board
+   @param unsigned int the number of columns in the board
+   @param unsigned int the number of rows in the board
+   @param enum type the representation for the board
+   @return board* a pointer to the board, which is the start of the block
+   */
+board* board_place(void* block, unsigned int width, unsigned int height,
+                   enum type type);
+
 /* Completely deallocates a passed board, including whichever internal 
    representation it is using. The function raises an error if the board
    claims to not use the matrix representation. 
@@ -54,6 +114,16 @@ board* board_new(unsigned int width, unsigned int height, enum type type);
    */
 void board_free(board* b);
 
+/* Determines the label that will be displayed for either a row or column.
+   The lables follow the specifications stated in the description of the 
+   board_show function: the digits 0-9, the capital letters A-Z, the lower
+   case letters a-z, then '?'.
+
+   @param unsinged int the row or column that we are finding the label for
+   @return char the label of the row or column
+   */
+char find_label(unsigned int l);
+
 /* Prints the passed board to the screen, along with row and column headers. 
    Specifically, the row headers will be to the left of the board, with one
    space to the left of the board. The column headers will be displayed one
@@ -64,11 +134,75 @@ void board_free(board* b);
    an EMPTY value will be represented with the character '.'. A cell that 
    is has the value BLACK will be represented with the character '*'.
    A cell that has the value WHITE will be represented with the character 'o'.
+   The board is rendered into a buffer that is kept between calls (see
+   board_render), then written to standard output with a single write, 
+   after anything printf has buffered. The cells are shown as they are
+   stored, so the board of a lazy game is shown with game_show instead.
 
    @param board* the board we are visually representing. 
    */
 void board_show(board* b);
 
+/* Finds the number of bytes board_render writes for a board of a given
+   size.
+
+   @param unsigned int the number of columns of the board
+   @param unsigned int the number of rows of the board
+   @return size_t the number of bytes of the rendered board
+   */
+size_t board_render_size(unsigned int width, unsigned int height);
+
+/* Renders a board as board_show displays it into a buffer, which must have
+   room for board_render_size bytes. No null character is added.
+
+   @param board* the board that we are rendering
+   @param char* the buffer that the board is rendered into
+   @return size_t the number of bytes written
+   */
+size_t board_render(board* b, char* out);
+
+
+/* A view of a board on an ANSI terminal that remembers the frame it drew
+   last, so that only the cells that changed are drawn again. */
+struct board_view {
+    unsigned int width, height;
+    int fd;
+    bool drawn;
+    char* frame;
+    char* out;
+    size_t out_cap;
+};
+
+typedef struct board_view board_view;
+
+/* Creates a view of a board for an ANSI terminal. Its buffers are sized
+   for the board up front, so drawing never allocates.
+
+   @param unsigned int the number of columns of the board
+   @param unsigned int the number of rows of the board
+   @param int the file descriptor of the terminal
+   @return board_view* a pointer to the view that has been created
+   */
+board_view* board_view_new(unsigned int width, unsigned int height, int fd);
+
+/* Completely deallocates a view.
+
+   @param board_view* the view that we are deallocating
+   */
+void board_view_free(board_view* v);
+
+/* Draws a board on the terminal of a view with a single write. The first
+   frame clears the screen and draws the whole board as board_show does;
+   after that only the cells that differ from the last frame are drawn,
+   by moving the cursor to them with ANSI escape codes, so a drop costs
+   one cell and an offset two columns. Either way the cursor is left on
+   the line below the board, and everything below it is cleared.
+
+   @param board_view* the view
+   @param board* the board that we are drawing, of the size of the view
+   */
+void board_view_draw(board_view* v, board* b);
+
 /* Retrives a cell in a given board at a provided position. 
 
    @param board* the board that we are pulling positions from
@@ -85,4 +219,232 @@ cell board_get(board* b, pos p);
    */
 void board_set(board* b, pos p, cell c);
 
+/* Finds the number of 64 bit words needed to hold one player's bitboard. Each
+   column takes height + 1 bits, the extra bit being the empty separator that
+   keeps runs from wrapping from the top of one column into the next.
+
+   @param unsigned int the number of columns in the board
+   @param unsigned int the number of rows in the board
+   @return unsigned int the number of words in a single player's bitboard
+   */
+static inline unsigned int plane_words(unsigned int width, 
+                                       unsigned int height) {
+  return (unsigned int) (((uint64_t) (height + 1) * width + 63) / 64);
+}
+
+/* Finds the bit index of a position in a player's bitboard, using the padded
+   column layout in which the bottom row of each column is its lowest bit.
+
+   @param board* the board that the position belongs to
+   @param pos the position that we are locating
+   @return uint64_t the index of the bit for that position
+   */
+static inline uint64_t plane_index(board* b, pos p) {
+  return (uint64_t) p.c * (b->height + 1) + (b->height - 1 - p.r);
+}
+
+/* Finds the bit index of a position in a board that uses the columns
+   representation, counting from the first bit of the first column.
+
+   @param board* the board that the position belongs to
+   @param pos the position that we are locating
+   @return uint64_t the index of the lower of the two bits of the cell
+   */
+static inline uint64_t column_index(board* b, pos p) {
+  return (uint64_t) p.c * b->stride * 64 + 2 * (b->height - 1 - p.r);
+}
+
+/* Retrieves a cell like board_get, but without checking the representation
+   of the board or that the position lies on it. It is meant for the inner
+   loops of the game logic, where positions are known to be valid; callers
+   that cannot be sure of that should use board_get.
+
+   @param board* the board that we are pulling positions from
+   @param pos the position, which must be on the board
+   @return cell the cell at the designated position on the board
+   */
+static inline cell board_get_unchecked(board* b, pos p) {
+  switch (b->type) {
+    case MATRIX:
+      return (cell) b->u.matrix[(size_t) p.r * b->stride + p.c];
+    case BITS: {
+      unsigned int bit_index = (p.r * b->width + p.c) * 2;
+      return (cell) ((b->u.bits[bit_index / 32] >> (bit_index % 32)) & 0x3);
+    }
+    case COLUMNS: {
+      uint64_t i = column_index(b, p);
+      return (cell) ((b->u.columns[i / 64] >> (i % 64)) & 0x3);
+    }
+    default: {
+      uint64_t i = plane_index(b, p);
+      uint64_t mask = (uint64_t) 1 << (i % 64);
+      if (b->u.planes[i / 64] & mask) {
+        return BLACK;
+      }
+      if (b->u.planes[plane_words(b->width, b->height) + i / 64] & mask) {
+        return WHITE;
+      }
+      return EMPTY;
+    }
+  }
+}
+
+/* Modifies a cell like board_set, keeping the key of the board up to date,
+   but without checking the representation of the board or that the 
+   position lies on it.
+
+   @param board* the board we are changing
+   @param pos the position, which must be on the board
+   @param cell the new value of the cell at the designated position
+   */
+static inline void board_set_unchecked(board* b, pos p, cell c) {
+  b->key ^= cell_key(p, board_get_unchecked(b, p)) ^ cell_key(p, c);
+  switch (b->type) {
+    case MATRIX:
+      b->u.matrix[(size_t) p.r * b->stride + p.c] = (uint8_t) c;
+      break;
+    case BITS: {
+      unsigned int bit_index = (p.r * b->width + p.c) * 2;
+      unsigned int* word = &b->u.bits[bit_index / 32];
+      *word = (*word & ~(0x3u << (bit_index % 32))) | 
+                ((unsigned int) c << (bit_index % 32));
+      break;
+    }
+    case COLUMNS: {
+      uint64_t i = column_index(b, p);
+      uint64_t* word = &b->u.columns[i / 64];
+      *word = (*word & ~((uint64_t) 0x3 << (i % 64))) | 
+                ((uint64_t) c << (i % 64));
+      break;
+    }
+    default: {
+      uint64_t i = plane_index(b, p);
+      uint64_t mask = (uint64_t) 1 << (i % 64);
+      uint64_t* black = b->u.planes + i / 64;
+      uint64_t* white = black + plane_words(b->width, b->height);
+      *black = c == BLACK ? *black | mask : *black & ~mask;
+      *white = c == WHITE ? *white | mask : *white & ~mask;
+    }
+  }
+}
+
+/* Swaps the cells at two positions of a board. Swaps that touch different
+   columns may be run at the same time from different threads: in the bits
+   and bitboard representations, where neighbouring columns share words, the
+   words are updated with atomic exclusive-ors.
+
+   @param board* the board that we are changing
+   @param pos the position of the first cell
+   @param pos the position of the second cell
+   */
+void board_swap(board* b, pos p1, pos p2);
+
+/* Reverses the order of the bottom cells of a column, which is how disarray
+   flips a stack of pieces. Reversals of different columns may be run at the
+   same time from different threads, like board_swap. In the columns 
+   representation the reversal is a bit reverse of the field by pairs of
+   bits, a word at a time, with one shift across the words of a column
+   taller than 32 rows.
+
+   @param board* the board that we are changing
+   @param unsigned int the column that we are reversing
+   @param unsigned int the number of cells, counted from the bottom row, to
+   reverse
+   */
+void board_reverse_column(board* b, unsigned int c, unsigned int count);
+
+/* Empties a cell and lets the pieces stacked above it fall by one row, from
+   the given top row down to the row just above the cell. In the columns
+   representation the fall is a masked shift, carried across the words of a
+   column taller than 32 rows.
+
+   @param board* the board that we are changing
+   @param pos the position of the cell that is emptied
+   @param unsigned int the highest row that holds a piece that falls
+   */
+void board_fall(board* b, pos p, unsigned int top);
+
+/* Takes back board_fall: the pieces from the given top row down to the cell
+   rise by one row, and the cell is given a piece. The top row may be just
+   below the cell when no pieces are above it.
+
+   @param board* the board that we are changing
+   @param pos the position of the cell that is filled
+   @param unsigned int the highest row that holds a piece that rises
+   @param cell the piece that is put back into the cell
+   */
+void board_rise(board* b, pos p, unsigned int top, cell c);
+
+/* Reports if a player has a run of a given length anywhere on a board that
+   uses the bitboard representation. Runs are found by shifting the player's
+   bitboard by the distance between neighbouring cells in each direction
+   (1 for vertical, height + 1 for horizontal, height and height + 2 for the
+   diagonals) and taking the AND, so the cost is a handful of word operations
+   per direction rather than a scan of every cell. The function raises an 
+   error if the board is not a bitboard.
+
+   @param board* the board that we are checking
+   @param cell the player whose pieces we are looking for, either BLACK or
+   WHITE
+   @param unsigned int the number of pieces in a row that makes a run
+   @return bool true if the player has a run of at least the given length
+   */
+bool bitboard_has_run(board* b, cell player, unsigned int run);
+
+/* Reports if every cell of a board that uses the bitboard representation is
+   occupied. The function raises an error if the board is not a bitboard.
+
+   @param board* the board that we are checking
+   @return bool true if there are no EMPTY cells left on the board
+   */
+bool bitboard_full(board* b);
+
+
+enum simd_level {
+    SIMD_SCALAR,
+    SIMD_SSE2,
+    SIMD_AVX2
+};
+
+typedef enum simd_level simd_level;
+
+/* Reports if a player has a run of a given length anywhere on a board that
+   uses the matrix representation and is at most 64 columns wide. Each row
+   is turned into a 64 bit mask of the player's cells by comparing the whole
+   row against the player at once with vector instructions, 16 or 32 cells
+   per compare. Runs are then found with shifts and ANDs of the masks: of 
+   each mask with itself for horizontal runs, and of the masks of the rows
+   below, shifted by one column per row for the diagonals, for the others.
+   The vector kernel is chosen when the function is first called, from the 
+   best one the processor supports (see matrix_simd). The function raises 
+   an error if the board is not a matrix or is too wide.
+
+   @param board* the board that we are checking
+   @param cell the player whose pieces we are looking for, either BLACK or
+   WHITE
+   @param unsigned int the number of pieces in a row that makes a run
+   @return bool true if the player has a run of at least the given length
+   */
+bool matrix_has_run(board* b, cell player, unsigned int run);
+
+/* Reports if every cell of a board that uses the matrix representation and
+   is at most 64 columns wide is occupied, comparing whole rows at once like
+   matrix_has_run. The function raises an error if the board is not a 
+   matrix or is too wide.
+
+   @param board* the board that we are checking
+   @return bool true if there are no EMPTY cells left on the board
+   */
+bool matrix_full(board* b);
+
+/* Chooses the vector kernel used by matrix_has_run and matrix_full. A level
+   the processor does not support is lowered to the best one it does, and 
+   the scalar kernel is always available. Every kernel gives the same 
+   results; choosing one is meant for testing and benchmarking.
+
+   @param simd_level the kernel that we would like to use
+   @return simd_level the kernel that is used from now on
+   */
+simd_level matrix_simd(simd_level level);
+
 #endif /* BOARD_H */
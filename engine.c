@@ -0,0 +1,395 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include "engine.h"
+
+/* Scores at least this close to ENGINE_WIN are wins or losses found by the
+   search rather than evaluations, and are stored in the table relative to
+   the position they belong to instead of the root. */
+#define ENGINE_DECIDED (ENGINE_WIN - 10000)
+
+/* The number of nodes searched between two looks at the clock. */
+#define ENGINE_CLOCK_NODES 4096
+
+enum bound {
+    BOUND_EXACT,
+    BOUND_LOWER,
+    BOUND_UPPER
+};
+
+typedef enum bound bound;
+
+
+struct tt_entry {
+    uint64_t key;
+    int score;
+    unsigned int depth;
+    bound flag;
+    move best;
+};
+
+typedef struct tt_entry tt_entry;
+
+
+struct engine {
+  tt_entry* table;
+  uint64_t mask;
+
+  move* moves;               // one list of moves for each ply of the search
+  unsigned int moves_cap;
+
+  unsigned long long nodes;
+  struct timespec start;
+  unsigned int ms;
+  bool stop;
+  move best;                 // the best move found at the root so far
+  solvedb* db;
+};
+
+engine* engine_new(unsigned int bits) {
+  if (bits > 32) {
+    fprintf(stderr, "engine_new, table too large\n");
+    exit(1);
+  }
+
+  engine* res = (engine*) malloc(sizeof(engine));
+  if (!res) {
+    fprintf(stderr, "engine_new, unable to allocate result\n");
+    exit(1);
+  }
+
+  res->table = (tt_entry*) calloc((size_t) 1 << bits, sizeof(tt_entry));
+  if (!res->table) {
+    fprintf(stderr, "engine_new, unable to allocate table\n");
+    exit(1);
+  }
+  res->mask = ((uint64_t) 1 << bits) - 1;
+  res->moves = NULL;
+  res->moves_cap = 0;
+  res->db = NULL;
+  return res;
+}
+
+void engine_free(engine* e) {
+  free(e->table);
+  free(e->moves);
+  free(e);
+}
+
+void engine_clear(engine* e) {
+  memset(e->table, 0, (size_t) (e->mask + 1) * sizeof(tt_entry));
+}
+
+void engine_use_db(engine* e, solvedb* db) {
+  e->db = db;
+}
+
+/* Finds the number of seconds that have passed since a search started.
+
+   @param engine* the engine that is searching
+   @return double the seconds since the start of the search
+   */
+double elapsed(engine* e) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - e->start.tv_sec) +
+           (now.tv_nsec - e->start.tv_nsec) / 1e9;
+}
+
+/* Scores a finished game for the player whose turn it is.
+
+   @param game* the finished game
+   @param outcome the outcome of the game
+   @param unsigned int the number of moves between the root and the game
+   @return int the score of the game
+   */
+int outcome_score(game* g, outcome o, unsigned int ply) {
+  if (o == DRAW) {
+    return 0;
+  }
+  bool black_to_move = g->player == BLACKS_TURN;
+  bool mover_won = (o == BLACK_WIN) == black_to_move;
+  return mover_won ? ENGINE_WIN - (int) ply : -(ENGINE_WIN - (int) ply);
+}
+
+/* Scores a position found in the database for the player whose turn it is,
+   the same way outcome_score scores the game it leads to.
+
+   @param solved the value of the position
+   @param unsigned int the number of moves between the root and the game
+   @return int the score of the position
+   */
+int solved_score(solved value, unsigned int ply) {
+  int score = ENGINE_WIN - (int) (ply + value.distance);
+  switch (value.result) {
+    case SOLVED_WIN:
+      return score;
+    case SOLVED_LOSS:
+      return -score;
+    default:
+      return 0;
+  }
+}
+
+/* Counts the pairs of touching pieces of one player, in any of the four
+   directions a run can take. Only the pieces in the queue of the player are
+   visited, so the cost follows the number of pieces rather than the size of
+   the board. The queues hold stored positions, which game_pos turns back
+   into cells while a lazy disarray has columns marked as flipped.
+
+   @param game* the game that we are evaluating
+   @param posqueue* the queue of the player
+   @param cell the colour of the player
+   @return int the number of pairs
+   */
+int count_pairs(game* g, posqueue* q, cell colour) {
+  static const int dirs[4][2] = {{0, 1}, {1, 0}, {1, 1}, {1, -1}};
+  int pairs = 0;
+  for (unsigned int i = 0; i < q->len; i++) {
+    pos p = game_pos(g, *posqueue_at(q, i));
+    for (unsigned int d = 0; d < 4; d++) {
+      int r = (int) p.r + dirs[d][0], c = (int) p.c + dirs[d][1];
+      if (r < 0 || c < 0 || r >= (int) g->b->height ||
+          c >= (int) g->b->width) {
+        continue;
+      }
+      if (game_cell(g, make_pos(r, c)) == colour) {
+        pairs++;
+      }
+    }
+  }
+  return pairs;
+}
+
+/* Scores a game that is still in progress for the player whose turn it is.
+
+   @param game* the game that we are evaluating
+   @return int the score of the game
+   */
+int evaluate(game* g) {
+  int black = count_pairs(g, g->black_queue, BLACK);
+  int white = count_pairs(g, g->white_queue, WHITE);
+  return g->player == BLACKS_TURN ? black - white : white - black;
+}
+
+/* Ranks a move for the search order: the move from the table first, then
+   drops from the centre outwards, then offset, then disarray. Lower ranks
+   are searched first.
+
+   @param game* the game the move belongs to
+   @param move the move that we are ranking
+   @param move* the move stored in the table, or NULL if there is none
+   @return unsigned int the rank of the move
+   */
+unsigned int move_rank(game* g, move m, move* tt_move) {
+  if (tt_move && tt_move->type == m.type && tt_move->column == m.column) {
+    return 0;
+  }
+  switch (m.type) {
+    case MOVE_DROP: {
+      unsigned int w = g->b->width;
+      unsigned int twice = 2 * m.column + 1;
+      return 1 + (twice > w ? twice - w : w - twice);
+    }
+    case MOVE_OFFSET:
+      return 2 * g->b->width + 2;
+    default:
+      return 2 * g->b->width + 3;
+  }
+}
+
+/* Sorts a short list of moves by rank with an insertion sort.
+
+   @param game* the game the moves belong to
+   @param move* the list of moves
+   @param unsigned int the number of moves
+   @param move* the move stored in the table, or NULL if there is none
+   */
+void order_moves(game* g, move* moves, unsigned int n, move* tt_move) {
+  for (unsigned int i = 1; i < n; i++) {
+    move m = moves[i];
+    unsigned int rank = move_rank(g, m, tt_move);
+    unsigned int j = i;
+    while (j > 0 && move_rank(g, moves[j - 1], tt_move) > rank) {
+      moves[j] = moves[j - 1];
+      j--;
+    }
+    moves[j] = m;
+  }
+}
+
+/* Converts a score between the form used by the search, where wins are
+   counted from the root, and the form stored in the table, where they are
+   counted from the position itself.
+
+   @param int the score to convert
+   @param int the ply of the position, negated to convert back
+   @return int the converted score
+   */
+int shift_score(int score, int ply) {
+  if (score >= ENGINE_DECIDED) {
+    return score + ply;
+  }
+  if (score <= -ENGINE_DECIDED) {
+    return score - ply;
+  }
+  return score;
+}
+
+/* Searches a game to a fixed depth with negamax alpha-beta and the
+   transposition table. At the root the best move is stored in the engine.
+
+   @param engine* the engine that is searching
+   @param game* the game being searched
+   @param unsigned int the depth left to search
+   @param int the lowest score the mover is already sure of
+   @param int the highest score the opponent will allow
+   @param unsigned int the number of moves between the root and the game
+   @return int the score of the game for the player whose turn it is
+   */
+int negamax(engine* e, game* g, unsigned int depth, int alpha, int beta,
+            unsigned int ply) {
+  e->nodes++;
+  if (e->ms && e->nodes % ENGINE_CLOCK_NODES == 0 &&
+      elapsed(e) * 1000 >= e->ms) {
+    e->stop = true;
+  }
+  if (e->stop) {
+    return 0;
+  }
+
+  outcome o = game_outcome(g);
+  if (o != IN_PROGRESS) {
+    return outcome_score(g, o, ply);
+  }
+  solved value;
+  if (e->db && ply > 0 && solvedb_lookup(e->db, g, &value)) {
+    return solved_score(value, ply);
+  }
+  if (depth == 0) {
+    return evaluate(g);
+  }
+
+  uint64_t key = game_key(g);
+  tt_entry* entry = &e->table[key & e->mask];
+  move* tt_move = NULL;
+  if (entry->key == key) {
+    tt_move = &entry->best;
+    if (ply > 0 && entry->depth >= depth) {
+      int score = shift_score(entry->score, -(int) ply);
+      if (entry->flag == BOUND_EXACT ||
+          (entry->flag == BOUND_LOWER && score >= beta) ||
+          (entry->flag == BOUND_UPPER && score <= alpha)) {
+        return score;
+      }
+    }
+  }
+
+  move* moves = e->moves + ply * (g->b->width + 2);
+  unsigned int n = legal_moves(g, moves);
+  order_moves(g, moves, n, tt_move);
+
+  int start_alpha = alpha, best_score = -ENGINE_WIN - 1;
+  move best = moves[0];
+  for (unsigned int i = 0; i < n; i++) {
+    game_make_move(g, moves[i]);
+    int score = -negamax(e, g, depth - 1, -beta, -alpha, ply + 1);
+    game_unmake_move(g);
+    if (e->stop) {
+      return 0;
+    }
+    if (score > best_score) {
+      best_score = score;
+      best = moves[i];
+    }
+    if (score > alpha) {
+      alpha = score;
+    }
+    if (alpha >= beta) {
+      break;
+    }
+  }
+
+  if (ply == 0) {
+    e->best = best;
+  }
+  entry->key = key;
+  entry->score = shift_score(best_score, ply);
+  entry->depth = depth;
+  entry->best = best;
+  if (best_score <= start_alpha) {
+    entry->flag = BOUND_UPPER;
+  } else if (best_score >= beta) {
+    entry->flag = BOUND_LOWER;
+  } else {
+    entry->flag = BOUND_EXACT;
+  }
+  return best_score;
+}
+
+move engine_search(engine* e, game* g, unsigned int depth, unsigned int ms,
+                   engine_stats* stats) {
+  unsigned int need = (depth + 1) * (g->b->width + 2);
+  if (need > e->moves_cap) {
+    move* moves = (move*) realloc(e->moves, need * sizeof(move));
+    if (!moves) {
+      fprintf(stderr, "engine_search, unable to allocate moves\n");
+      exit(1);
+    }
+    e->moves = moves;
+    e->moves_cap = need;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &e->start);
+  e->ms = ms;
+  e->nodes = 0;
+  e->stop = false;
+
+  // equal positions of a lazy game may have different keys, so the table
+  // and the database are only used on games with no marked columns
+  bool lazy = g->lazy;
+  game_set_lazy(g, false);
+
+  solved value;
+  move best;
+  if (e->db && solvedb_best_move(e->db, g, &best, &value)) {
+    game_set_lazy(g, lazy);
+    if (stats) {
+      stats->nodes = 0;
+      stats->seconds = elapsed(e);
+      stats->depth = 0;
+      stats->score = solved_score(value, 0);
+    }
+    return best;
+  }
+
+  legal_moves(g, e->moves);
+  e->best = e->moves[0];
+  best = e->best;
+  unsigned int reached = 0;
+  int score = 0;
+  for (unsigned int d = 1; d <= depth; d++) {
+    int s = negamax(e, g, d, -ENGINE_WIN - 1, ENGINE_WIN + 1, 0);
+    if (e->stop) {
+      break;
+    }
+    best = e->best;
+    reached = d;
+    score = s;
+    // nothing deeper can change a forced result
+    if (s >= ENGINE_DECIDED || s <= -ENGINE_DECIDED) {
+      break;
+    }
+  }
+  game_set_lazy(g, lazy);
+
+  if (stats) {
+    stats->nodes = e->nodes;
+    stats->seconds = elapsed(e);
+    stats->depth = reached;
+    stats->score = score;
+  }
+  return best;
+}
@@ -0,0 +1,84 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <stdint.h>
+#include "logic.h"
+#include "solvedb.h"
+
+/* The score of a position where the side to move has already won. A win
+   found n moves from the root scores ENGINE_WIN - n, so that quicker wins
+   are preferred and slower losses are held off. */
+#define ENGINE_WIN 1000000
+
+
+struct engine_stats {
+    unsigned long long nodes;
+    double seconds;
+    unsigned int depth;
+    int score;
+};
+
+typedef struct engine_stats engine_stats;
+
+
+struct engine;
+
+typedef struct engine engine;
+
+/* Creates a search engine with a transposition table of 2^bits entries. The
+   table is indexed by game_key and is kept between searches, so an engine
+   should only be used for one game at a time.
+
+   @param unsigned int the base two logarithm of the number of table entries
+   @return engine* a pointer to the engine that has been created
+   */
+engine* engine_new(unsigned int bits);
+
+/* Completely deallocates an engine and its transposition table.
+
+   @param engine* the engine that we are deallocating
+   */
+void engine_free(engine* e);
+
+/* Empties the transposition table of an engine, for example before it is
+   used for a new game.
+
+   @param engine* the engine whose table we are clearing
+   */
+void engine_clear(engine* e);
+
+/* Hands an engine a database of solved positions, or takes it away with
+   NULL. While an engine has a database, a search first looks the game up
+   and plays perfectly from the database if the game is found, and any
+   position in the database that the search reaches is scored exactly
+   instead of being searched further.
+
+   @param engine* the engine that is given the database
+   @param solvedb* the database, which must outlive its use by the engine
+   */
+void engine_use_db(engine* e, solvedb* db);
+
+/* Finds the best move for the player whose turn it is with an iterative
+   deepening alpha-beta search. The moves are played with game_make_move and
+   taken back with game_unmake_move, so the game is left exactly as it was.
+   The search turns lazy disarray off for the game while it runs, since the
+   keys of a lazy game depend on which columns are marked (see game_key) and
+   the table would miss transpositions. Every depth from one up to the limit
+   is searched in turn, and if the time limit runs out during a depth the
+   best move of the last finished depth is returned. Positions below the
+   horizon are scored by how many pairs of touching pieces each player has. A
+   disarray is always a legal move, so a move is returned as long as the game
+   is in progress.
+
+   @param engine* the engine that runs the search
+   @param game* the game that we are searching
+   @param unsigned int the deepest search, in moves
+   @param unsigned int the time limit in milliseconds, or 0 for no limit
+   @param engine_stats* where the statistics of the search are stored, or
+   NULL if they are not needed
+   @return move the best move that was found
+   */
+move engine_search(engine* e, game* g, unsigned int depth, unsigned int ms,
+                   engine_stats* stats);
+
+#endif /* ENGINE_H */
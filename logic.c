@@ -1,199 +1,763 @@
 #include <stdlib.h>
 #include <stdio.h>
-#include <pthread.h>
+#include <stddef.h>
+#include <string.h>
 #include "logic.h"
+#include "pool.h"
 
-game* new_game(unsigned int run, unsigned int width,
-               unsigned int height, enum type type) {
+/* The number of pieces disarray flips in the time it takes to hand a job to
+   the worker pool and wait for it. bench flips a half full 62x62 board
+   (1922 pieces) in 52-73 us depending on the type, about 27-38 ns a piece,
+   and a pool_run of an empty task with one worker takes about 9 us, so the
+   hand-off costs about as much as flipping 330 pieces, rounded up. */
+#define PARALLEL_DISARRAY_HANDOFF_PIECES 384
+
+/* The alignment of the block that holds a game, and of the board inside it,
+   which is the size of a cache line. */
+#define GAME_BLOCK_ALIGN 64
+
+/* Where each part of a game is placed in the single block that holds it,
+   as byte offsets from the start of the block, which holds the game struct
+   itself. */
+struct layout {
+    size_t board, queues, entries, dirty, heights, slots, flipped, size;
+};
+
+typedef struct layout layout;
+
+/* Rounds a number up to the next multiple of another.
+
+   @param size_t the number that we are rounding
+   @param size_t the multiple that we are rounding up to
+   @return size_t the smallest multiple that is at least the number
+   */
+size_t align_up(size_t n, size_t multiple) {
+  return (n + multiple - 1) / multiple * multiple;
+}
+
+/* Lays out the parts of a game in one block: the game struct, the board and
+   its cells on a cache line of their own, both queues and their arrays,
+   the dirty rows and columns, the column heights, the index of queue 
+   slots, and the flipped columns.
+
+   @param layout* where the offsets are stored
+   @param unsigned int the number of columns the board has
+   @param unsigned int the number of rows the board has
+   @param enum type the type of the representation the board uses
+   */
+void game_layout(layout* l, unsigned int width, unsigned int height,
+                 enum type type) {
+  size_t cells = (size_t) width * height;
+  l->board = align_up(sizeof(game), GAME_BLOCK_ALIGN);
+  l->queues = l->board + board_size(width, height, type);
+  l->entries = align_up(l->queues + 2 * sizeof(posqueue), sizeof(uint64_t));
+  l->dirty = align_up(l->entries + 2 * cells * sizeof(pos), 
+                      sizeof(uint64_t));
+  l->heights = l->dirty + 3 * (size_t) width * sizeof(unsigned int);
+  l->slots = l->heights + (size_t) width * sizeof(unsigned int);
+  l->flipped = l->slots + cells * sizeof(unsigned int);
+  l->size = align_up(l->flipped + width * sizeof(bool), GAME_BLOCK_ALIGN);
+}
+
+/* Sets up a new, empty game in a block laid out by game_layout.
+
+   @param char* the block that holds the game
+   @param layout* the layout of the block
+   @param arena* the arena the block was carved from, or NULL if it was
+   allocated on its own
+   @param unsigned int the number of cells in a row to make a run
+   @param unsigned int the number of columns the board has
+   @param unsigned int the number of rows the board has
+   @param enum type the type of the representation the board should use
+   @return game* the game, which is the start of the block
+   */
+game* place_game(char* block, layout* l, arena* a, unsigned int run, 
+                 unsigned int width, unsigned int height, enum type type) {
+  game* res = (game*) block;
+  res->size = l->size;
+  res->arena = a;
+
+  res->run = run;
+  res->player = BLACKS_TURN;
+  res->b = board_place(block + l->board, width, height, type);
+  // neither player can ever have more pieces on the board than it has cells,
+  // so the queues never outgrow their part of the block
+  res->black_queue = (posqueue*) (block + l->queues);
+  res->white_queue = res->black_queue + 1;
+  pos* entries = (pos*) (block + l->entries);
+  posqueue_init(res->black_queue, entries, width * height);
+  posqueue_init(res->white_queue, entries + width * height, width * height);
+
+  res->black_runs = false;
+  res->white_runs = false;
+  res->rescan = false;
+  // the lowest and highest dirty row of every column, then the list of 
+  // columns that are currently dirty
+  res->dirty_lo = (unsigned int*) (block + l->dirty);
+  res->dirty_hi = res->dirty_lo + width;
+  res->dirty_cols = res->dirty_hi + width;
+  res->dirty_len = 0;
+  res->col_height = (unsigned int*) (block + l->heights);
+  for (unsigned int c = 0; c < width; c++) {
+    res->dirty_lo[c] = 1;
+    res->dirty_hi[c] = 0;
+    res->col_height[c] = 0;
+  }
+
+  // the queue slot of the piece in every cell, which stays put because the
+  // queues never grow
+  res->entry_slot = (unsigned int*) (block + l->slots);
+
+  res->lazy = false;
+  res->flipped = (bool*) (block + l->flipped);
+  for (unsigned int c = 0; c < width; c++) {
+    res->flipped[c] = false;
+  }
+  res->flipped_len = 0;
+  res->flip_key = 0;
+
+  res->undo_stack = NULL;
+  res->undo_len = 0;
+  res->undo_cap = 0;
+  return res;
+}
+
+/* Raises an error if a run cannot be made on a board of the given size.
+
+   @param unsigned int the number of cells in a row to make a run
+   @param unsigned int the number of columns the board has
+   @param unsigned int the number of rows the board has
+   @param char* the function name that called the check, used for error 
+   logging
+   */
+void check_run_fits(unsigned int run, unsigned int width, 
+                    unsigned int height, char* function_name) {
   if (run > height && run > width) {
-    fprintf(stderr, "new_game, not possible to make run in board\n");
+    fprintf(stderr, "%s, not possible to make run in board\n", 
+            function_name);
     exit(1);
   } 
+}
 
-  game* res = (game*) malloc (sizeof(game));
-  if (!res) {
+game* new_game(unsigned int run, unsigned int width,
+               unsigned int height, enum type type) {
+  check_run_fits(run, width, height, "new_game");
+
+  layout l;
+  game_layout(&l, width, height, type);
+  char* block = (char*) aligned_alloc(GAME_BLOCK_ALIGN, l.size);
+  if (!block) {
     fprintf(stderr, "new_game, unable to allocate result");
     exit(1);
   }
+  return place_game(block, &l, NULL, run, width, height, type);
+}
 
-  res->run = run;
-  res->player = BLACKS_TURN;
-  res->b = board_new(width, height, type);
-  res->black_queue = posqueue_new();
-  res->white_queue = posqueue_new();
-  return res;
+game* new_game_in(arena* a, unsigned int run, unsigned int width,
+                  unsigned int height, enum type type) {
+  check_run_fits(run, width, height, "new_game_in");
+
+  layout l;
+  game_layout(&l, width, height, type);
+  char* block = (char*) arena_alloc(a, l.size, GAME_BLOCK_ALIGN);
+  return place_game(block, &l, a, run, width, height, type);
 }
 
 void game_free(game* g) {
-  board_free(g->b);
-  posqueue_free(g->black_queue);
-  posqueue_free(g->white_queue);
+  if (g->arena) {
+    return;
+  }
+  free(g->undo_stack);
   free(g);
 }
 
-bool drop_piece(game* g, unsigned int column){
-  if (column >= g->b->width) {
-    return false;
+/* Moves a pointer into the block of one game to the same place in the block
+   of another.
+
+   @param const void* the pointer into the block of the first game
+   @param const game* the first game
+   @param game* the second game
+   @return void* the pointer into the block of the second game
+   */
+void* rebase(const void* p, const game* from, game* to) {
+  return (char*) to + ((const char*) p - (const char*) from);
+}
+
+/* Copies the block of one game over the block of another of the same size,
+   then moves every pointer of the copy into its own block. The undo stack 
+   of the copy is left empty.
+
+   @param game* the game that we are copying into
+   @param const game* the game that we are copying
+   @param arena* the arena the block we are copying into was carved from,
+   or NULL
+   @param undo* the undo stack of the game we are copying into
+   @param unsigned int the capacity of that undo stack
+   */
+void copy_block(game* dst, const game* src, arena* a, undo* stack, 
+                unsigned int cap) {
+  memcpy(dst, src, src->size);
+  dst->arena = a;
+  dst->b = (board*) rebase(src->b, src, dst);
+  dst->b->u.matrix = (uint8_t*) rebase(src->b->u.matrix, src, dst);
+  dst->black_queue = (posqueue*) rebase(src->black_queue, src, dst);
+  dst->white_queue = (posqueue*) rebase(src->white_queue, src, dst);
+  dst->black_queue->entries = (pos*) rebase(src->black_queue->entries, 
+                                            src, dst);
+  dst->white_queue->entries = (pos*) rebase(src->white_queue->entries, 
+                                            src, dst);
+  dst->dirty_lo = (unsigned int*) rebase(src->dirty_lo, src, dst);
+  dst->dirty_hi = (unsigned int*) rebase(src->dirty_hi, src, dst);
+  dst->dirty_cols = (unsigned int*) rebase(src->dirty_cols, src, dst);
+  dst->col_height = (unsigned int*) rebase(src->col_height, src, dst);
+  dst->entry_slot = (unsigned int*) rebase(src->entry_slot, src, dst);
+  dst->flipped = (bool*) rebase(src->flipped, src, dst);
+  dst->undo_stack = stack;
+  dst->undo_cap = cap;
+  dst->undo_len = 0;
+}
+
+game* game_clone(const game* g) {
+  game* res = (game*) aligned_alloc(GAME_BLOCK_ALIGN, g->size);
+  if (!res) {
+    fprintf(stderr, "game_clone, unable to allocate result\n");
+    exit(1);
   }
+  copy_block(res, g, NULL, NULL, 0);
+  return res;
+}
 
-  for (int r = g->b->height - 1; r >= 0; r--) {
-    pos p = {r, column};
-    if (board_get(g->b, p) == EMPTY) {
-      switch (g->player) {
-        case BLACKS_TURN:
-          board_set(g->b, p, BLACK);
-          pos_enqueue(g->black_queue, p);
-          break;
-        case WHITES_TURN:
-          board_set(g->b, p, WHITE);
-          pos_enqueue(g->white_queue, p);
-          break;
-      }
-      g->player = (g->player + 1) % 2;
-      return true;
+void game_copy_into(game* dst, const game* src) {
+  if (dst->size != src->size || dst->b->width != src->b->width ||
+      dst->b->height != src->b->height || dst->b->type != src->b->type) {
+    fprintf(stderr, "game_copy_into, games do not have the same shape\n");
+    exit(1);
+  }
+  if (dst != src) {
+    copy_block(dst, src, dst->arena, dst->undo_stack, dst->undo_cap);
+  }
+}
+
+/* Records that the cells of a column between two rows, inclusive, have
+   changed since game_outcome was last called. A column is clean when its
+   lowest dirty row is greater than its highest, so an empty range, such as
+   the one left by an offset of the top piece of a column, marks nothing; 
+   otherwise the column would be listed again on the next call.
+
+   @param game* the game that was changed
+   @param unsigned int the column that was changed
+   @param unsigned int the first row that changed
+   @param unsigned int the last row that changed
+   */
+void mark_dirty(game* g, unsigned int c, unsigned int lo, unsigned int hi) {
+  if (lo > hi) {
+    return;
+  }
+  if (g->dirty_lo[c] > g->dirty_hi[c]) {
+    g->dirty_cols[g->dirty_len++] = c;
+    g->dirty_lo[c] = lo;
+    g->dirty_hi[c] = hi;
+    return;
+  }
+  if (lo < g->dirty_lo[c]) {
+    g->dirty_lo[c] = lo;
+  }
+  if (hi > g->dirty_hi[c]) {
+    g->dirty_hi[c] = hi;
+  }
+}
+
+/* Forgets every dirty cell of a game.
+
+   @param game* the game that we are cleaning
+   */
+void clear_dirty(game* g) {
+  for (unsigned int i = 0; i < g->dirty_len; i++) {
+    unsigned int c = g->dirty_cols[i];
+    g->dirty_lo[c] = 1;
+    g->dirty_hi[c] = 0;
+  }
+  g->dirty_len = 0;
+}
+
+/* Makes the next game_outcome scan the whole board. Used when a move may have
+   broken a run that was already found, since the remembered flags cannot be
+   cleared by looking only at changed cells.
+
+   @param game* the game that we are invalidating
+   */
+void invalidate_if_runs(game* g) {
+  if (g->black_runs || g->white_runs) {
+    g->rescan = true;
+  }
+}
+
+void game_invalidate(game* g) {
+  g->rescan = true;
+}
+
+void game_reset(game* g) {
+  posqueue* queues[2] = {g->black_queue, g->white_queue};
+  for (unsigned int k = 0; k < 2; k++) {
+    posqueue* q = queues[k];
+    for (unsigned int i = 0; i < q->len; i++) {
+      board_set_unchecked(g->b, *posqueue_at(q, i), EMPTY);
     }
+    q->head = 0;
+    q->len = 0;
+    q->sum = 0;
+    q->key = 0;
+  }
+  for (unsigned int c = 0; c < g->b->width; c++) {
+    g->col_height[c] = 0;
+    g->flipped[c] = false;
+  }
+  g->flipped_len = 0;
+  g->flip_key = 0;
+  clear_dirty(g);
+  g->black_runs = false;
+  g->white_runs = false;
+  g->rescan = false;
+  g->player = BLACKS_TURN;
+  g->undo_len = 0;
+}
+
+game_pool* game_pool_new(arena* a, unsigned int run, unsigned int width,
+                         unsigned int height, enum type type) {
+  check_run_fits(run, width, height, "game_pool_new");
+  game_pool* res = (game_pool*) malloc(sizeof(game_pool));
+  if (!res) {
+    fprintf(stderr, "game_pool_new, unable to allocate result\n");
+    exit(1);
   }
-  return false;
-}
-/* Updates the position queues to reflect the changes made by disarray. The 
-   function only loops through the queue once, relying on a list of the number
-   of pieces in each column, refered to by the array col_height.
-
-   @param posqueue* the queue that we are altering
-   @param unsigned int the height of the board that we have altered, used for 
-   calculations
-   @param unsigned int* the list of the number of pieces in each column
-   */
-void disarray_update_queue(posqueue* q, unsigned int height, 
-                                        unsigned int* col_height) {
-  pq_entry* current = q->head;
-  while (current) {
-    pos old_p = current->p;
-    pos new_p = {old_p.r, old_p.c};
-    // finding the middle index of the stack of pieces in a column
-    // note: avoided using floats by multiplying by 2
-    unsigned int mid_i = 2 * height - (col_height[old_p.c] - 1) - 2;
-    if (2 * old_p.r < mid_i) {
-      //performing the swap if it got swapped down
-      new_p.r = (height-1) - (old_p.r - (height - col_height[old_p.c]));
-      //bottom index - (old index - column start index)
-    } else if (2 * old_p.r > mid_i) {
-      //performing the swap if it got swapped up
-      new_p.r = (height - col_height[old_p.c]) + (height - 1 - old_p.r);
-      //column start index + index of cell from bottom
+  res->arena = a;
+  res->run = run;
+  res->width = width;
+  res->height = height;
+  res->type = type;
+  res->games = NULL;
+  res->len = 0;
+  res->cap = 0;
+  return res;
+}
+
+game* game_pool_get(game_pool* p) {
+  if (p->len > 0) {
+    return p->games[--(p->len)];
+  }
+  if (p->arena) {
+    return new_game_in(p->arena, p->run, p->width, p->height, p->type);
+  }
+  return new_game(p->run, p->width, p->height, p->type);
+}
+
+void game_pool_put(game_pool* p, game* g) {
+  if (p->len == p->cap) {
+    unsigned int cap = p->cap == 0 ? 8 : 2 * p->cap;
+    game** games = (game**) realloc(p->games, sizeof(game*) * cap);
+    if (!games) {
+      fprintf(stderr, "game_pool_put, unable to grow free list\n");
+      exit(1);
     }
-    current->p = new_p;
+    p->games = games;
+    p->cap = cap;
+  }
+  game_reset(g);
+  g->lazy = false;
+  p->games[p->len++] = g;
+}
+
+void game_pool_free(game_pool* p) {
+  for (unsigned int i = 0; i < p->len; i++) {
+    game_free(p->games[i]);
+  }
+  free(p->games);
+  free(p);
+}
+
+uint64_t game_key(game* g) {
+  // the white queue is scaled by an odd constant so that swapping the queues
+  // of the two players changes the key
+  uint64_t key = g->b->key ^ g->black_queue->key ^ 
+                   (g->white_queue->key * 0xD6E8FEB86659FD93ULL) ^
+                   g->flip_key;
+  if (g->player == WHITES_TURN) {
+    key ^= 0xA0761D6478BD642FULL;
+  }
+  return key;
+}
+
+/* Finds the index of a cell in the per-cell arrays of a game.
+
+   @param game* the game the cell belongs to
+   @param pos the position of the cell
+   @return unsigned int the index of the cell
+   */
+unsigned int cell_index(game* g, pos p) {
+  return p.r * g->b->width + p.c;
+}
+
+/* Finds the queue of the player who owns a piece.
+
+   @param game* the game the piece belongs to
+   @param cell the piece, either BLACK or WHITE
+   @return posqueue* the queue of the owner of the piece
+   */
+posqueue* owner_queue(game* g, cell c) {
+  return c == BLACK ? g->black_queue : g->white_queue;
+}
+
+/* Records the queue slot of the newest position of a queue, after a piece
+   was added to its cell.
+
+   @param game* the game the queue belongs to
+   @param posqueue* the queue that a position was added to
+   */
+void index_newest(game* g, posqueue* q) {
+  unsigned int s = posqueue_slot(q, q->len - 1);
+  g->entry_slot[cell_index(g, q->entries[s])] = s;
+}
+
+/* Records the queue slot of the oldest position of a queue, after a piece
+   was added to its cell.
 
-    current = current->next;
+   @param game* the game the queue belongs to
+   @param posqueue* the queue that a position was added to
+   */
+void index_oldest(game* g, posqueue* q) {
+  unsigned int s = posqueue_slot(q, 0);
+  g->entry_slot[cell_index(g, q->entries[s])] = s;
+}
+
+/* Moves the queue entry of a piece, and its place in the index, from one 
+   cell to another. Only the index and the queue are changed; the board is
+   read to find the owner of the piece, so this is called before the board
+   moves the piece.
+
+   @param game* the game that the piece belongs to
+   @param pos the cell that the piece is in
+   @param pos the cell that the piece is moving to
+   */
+void move_entry(game* g, pos from, pos to) {
+  posqueue* q = owner_queue(g, board_get_unchecked(g->b, from));
+  unsigned int s = g->entry_slot[cell_index(g, from)];
+  posqueue_set(q, posqueue_place(q, s), to);
+  g->entry_slot[cell_index(g, to)] = s;
+}
+
+/* Moves the queue entries of the pieces of a column that was flipped, using
+   the index to find them, so the queues are never walked. It is called 
+   after the board was flipped, so the owner of a piece is read from the 
+   cell the piece has moved to.
+
+   @param game* the game that the column belongs to
+   @param unsigned int the column that was flipped
+   */
+void flip_column_entries(game* g, unsigned int c) {
+  unsigned int height = g->b->height;
+  unsigned int count = g->col_height[c];
+  for (unsigned int i = 0; i < count / 2; i++) {
+    pos upper = make_pos(height - count + i, c);
+    pos lower = make_pos(height - 1 - i, c);
+    unsigned int* upper_slot = &g->entry_slot[cell_index(g, upper)];
+    unsigned int* lower_slot = &g->entry_slot[cell_index(g, lower)];
+    // the piece now in the lower cell came from the upper one
+    posqueue* q = owner_queue(g, board_get_unchecked(g->b, lower));
+    posqueue_set(q, posqueue_place(q, *upper_slot), lower);
+    q = owner_queue(g, board_get_unchecked(g->b, upper));
+    posqueue_set(q, posqueue_place(q, *lower_slot), upper);
+    unsigned int temp = *upper_slot;
+    *upper_slot = *lower_slot;
+    *lower_slot = temp;
   }
 }
 
-/* Runs disarray for a single column by swapping the pieces in the column. The
-   function does so by running a flipping algorithm. It also stores the height
-   of the column into an array of column heights. 
+/* Moves the queue entries of the pieces of every column that disarray
+   flipped. Columns with fewer than two pieces are skipped.
 
    @param game* the game that we are performing the disarray on
-   @param unsigned int the column that we are altering
-   @param unsigned int* the array of column heights
    */
-void disarray_single_column(game* g, unsigned int c, unsigned int* col_h) {
-  unsigned int r;
-  for (r = 0; r < g->b->height; r++) {
-    if (board_get(g->b, make_pos(r,c)) != EMPTY){
-      break;
-    } 
+void disarray_update_queues(game* g) {
+  for (unsigned int c = 0; c < g->b->width; c++) {
+    flip_column_entries(g, c);
   }
-  col_h[c] = g->b->height - r;
-  for (unsigned int i = 0; i < col_h[c] / 2; i++){
-    pos p1 = {r+i, c};
-    pos p2 = {g->b->height - i - 1, c};
-    cell temp = board_get(g->b, p1);
-    board_set(g->b, p1, board_get(g->b, p2));
-    board_set(g->b, p2, temp);
+}
+
+/* Finds the key that a column adds to the key of a game while a lazy 
+   disarray has marked it as flipped. The row just below the board is never
+   a cell, so its position keys cannot clash with those of the pieces.
+
+   @param game* the game that the column belongs to
+   @param unsigned int the column
+   @return uint64_t the key of the mark
+   */
+uint64_t flip_mark_key(game* g, unsigned int c) {
+  return pos_key(make_pos(g->b->height, c)) * 0x9E3779B97F4A7C15ULL;
+}
+
+/* Toggles the mark that a lazy disarray keeps on a column.
+
+   @param game* the game that the column belongs to
+   @param unsigned int the column whose mark we are toggling
+   */
+void toggle_flip_mark(game* g, unsigned int c) {
+  g->flipped[c] = !g->flipped[c];
+  if (g->flipped[c]) {
+    g->flipped_len++;
+  } else {
+    g->flipped_len--;
   }
+  g->flip_key ^= flip_mark_key(g, c);
 }
 
-struct args {
-  unsigned int c;
-  game* g;
-  unsigned int* col_height;
-};
+/* Flips the stored cells and the queue entries of one column and toggles its
+   mark, which leaves the state of the game unchanged. On a marked column 
+   this puts the column back in order before a move changes it, and doing it
+   again restores the marked column, which is how that is taken back.
 
-/* Wrapper function for the pthread call. Calls disarray on a single column
-   and takes in an args struct. 
+   @param game* the game that the column belongs to
+   @param unsigned int the column that we are settling
+   */
+void settle_column(game* g, unsigned int c) {
+  board_reverse_column(g->b, c, g->col_height[c]);
+  flip_column_entries(g, c);
+  toggle_flip_mark(g, c);
+}
 
-   @param void* an arguments struct. 
-   @return void* returns NULL always, as disarray is a void function
+/* Marks every column holding two or more pieces as flipped, or clears the
+   mark, without touching the board or the queues. Doing it twice restores
+   the marks, which is how a lazy disarray is taken back.
+
+   @param game* the game whose columns we are marking
    */
-void* disarray_wrapper(void* a) {
-  struct args* args = (struct args*) a;
-  unsigned int c = args->c;
-  game* g = args->g;
-  unsigned int* col_height = args->col_height;
+void mark_flipped_columns(game* g) {
+  for (unsigned int c = 0; c < g->b->width; c++) {
+    if (g->col_height[c] > 1) {
+      toggle_flip_mark(g, c);
+    }
+  }
+}
 
-  disarray_single_column(g, c, col_height);
+void game_set_lazy(game* g, bool lazy) {
+  g->lazy = lazy;
+  if (!lazy) {
+    game_sync(g);
+  }
+}
 
-  return NULL;
+void game_sync(game* g) {
+  for (unsigned int c = 0; g->flipped_len > 0 && c < g->b->width; c++) {
+    if (g->flipped[c]) {
+      settle_column(g, c);
+    }
+  }
 }
 
-void disarray(game* g) {
-  unsigned int* col_height = (unsigned int*) malloc 
-                                    (sizeof(unsigned int)*g->b->width);
-  if (!col_height) {
-    fprintf(stderr, "disarray, unable to allocate column heights\n");
-    exit(1);
+void game_show(game* g) {
+  game_sync(g);
+  board_show(g->b);
+}
+
+pos game_pos(game* g, pos p) {
+  if (g->flipped[p.c]) {
+    unsigned int height = g->b->height;
+    unsigned int top = height - g->col_height[p.c];
+    if (p.r >= top) {
+      p.r = top + height - 1 - p.r;
+    }
   }
-  pthread_t threads[g->b->width];
-  struct args args[g->b->width];
+  return p;
+}
 
-  for (unsigned int c = 0; c < g->b->width; c++) {
-    if (g->b->type == MATRIX) {
-      args[c].g = g;
-      args[c].c = c;
-      args[c].col_height = col_height;
-      pthread_create(&threads[c], NULL, disarray_wrapper, &args[c]);
-    } else {
-      disarray_single_column(g, c, col_height);
+cell game_cell(game* g, pos p) {
+  return board_get_unchecked(g->b, game_pos(g, p));
+}
+
+void game_set_position(game* g, const pos* black, unsigned int black_len,
+                       const pos* white, unsigned int white_len, turn player) {
+  game_reset(g);
+  const pos* pieces[2] = {black, white};
+  unsigned int lens[2] = {black_len, white_len};
+  posqueue* queues[2] = {g->black_queue, g->white_queue};
+  cell colours[2] = {BLACK, WHITE};
+  for (unsigned int k = 0; k < 2; k++) {
+    for (unsigned int i = 0; i < lens[k]; i++) {
+      pos p = pieces[k][i];
+      if (p.r >= g->b->height || p.c >= g->b->width ||
+          board_get_unchecked(g->b, p) != EMPTY) {
+        fprintf(stderr, "game_set_position, invalid piece\n");
+        exit(1);
+      }
+      board_set_unchecked(g->b, p, colours[k]);
+      pos_enqueue(queues[k], p);
+      index_newest(g, queues[k]);
+      g->col_height[p.c]++;
     }
   }
-  if (g->b->type == MATRIX) {
-    for (unsigned int c = 0; c < g->b->width; c++) {
-      pthread_join(threads[c], NULL);
+  // every piece must sit inside the stack that the height of its column
+  // describes, which also rules out gaps below a piece
+  for (unsigned int k = 0; k < 2; k++) {
+    for (unsigned int i = 0; i < lens[k]; i++) {
+      pos p = pieces[k][i];
+      if (p.r < g->b->height - g->col_height[p.c]) {
+        fprintf(stderr, "game_set_position, piece is not supported\n");
+        exit(1);
+      }
     }
   }
-    
-  disarray_update_queue(g->black_queue, g->b->height, col_height);
-  disarray_update_queue(g->white_queue, g->b->height, col_height);
+  g->player = player;
+  g->rescan = true;
+}
+
+bool drop_piece(game* g, unsigned int column){
+  if (column >= g->b->width || g->col_height[column] == g->b->height) {
+    return false;
+  }
+  if (g->flipped[column]) {
+    settle_column(g, column);
+  }
 
+  unsigned int r = g->b->height - 1 - g->col_height[column];
+  pos p = {r, column};
+  switch (g->player) {
+    case BLACKS_TURN:
+      board_set_unchecked(g->b, p, BLACK);
+      pos_enqueue(g->black_queue, p);
+      index_newest(g, g->black_queue);
+      break;
+    case WHITES_TURN:
+      board_set_unchecked(g->b, p, WHITE);
+      pos_enqueue(g->white_queue, p);
+      index_newest(g, g->white_queue);
+      break;
+  }
+  g->col_height[column]++;
+  mark_dirty(g, column, r, r);
   g->player = (g->player + 1) % 2;
-  free(col_height);
+  return true;
 }
 
-/* Updates the queues so they reflect gravity after a offset move is made. 
+/* Runs disarray for a single column by reversing the stack of pieces in the
+   column, whose size is given by the column heights of the game.
 
-   @param posqueue* the queue that we are updating
-   @param pos the position of the first cell that was removed
-   @param pos the position o fthe second cell that was removed. 
+   @param game* the game that we are performing the disarray on
+   @param unsigned int the column that we are altering
    */
-void offset_update_queue(posqueue* q, pos c1, pos c2) {
-  pq_entry* current = q->head;
-  while (current) {
-    pos p = current->p;
-    if (p.c == c1.c && p.r < c1.r) {
-      current->p.r++;
+void disarray_single_column(game* g, unsigned int c) {
+  board_reverse_column(g->b, c, g->col_height[c]);
+}
+
+/* Pool task that runs disarray on a chunk of columns. Columns never share
+   cells, and board_reverse_column keeps packed words consistent, so chunks
+   may run at the same time.
+
+   @param void* the game that we are performing the disarray on
+   @param unsigned int the first column of the chunk
+   @param unsigned int one past the last column of the chunk
+   */
+void disarray_columns(void* a, unsigned int lo, unsigned int hi) {
+  game* g = (game*) a;
+  for (unsigned int c = lo; c < hi; c++) {
+    disarray_single_column(g, c);
+  }
+}
+
+/* Flips the stack of pieces in every column and moves the queue entries 
+   along with them. Flipping twice restores the board and the queues, which
+   is how a disarray is taken back.
+
+   @param game* the game whose columns we are flipping
+   */
+void flip_columns(game* g) {
+  unsigned int pieces = g->black_queue->len + g->white_queue->len;
+
+  // splitting the columns over n threads saves the time of flipping
+  // pieces * (n - 1) / n of them, which has to pay for the hand-off, and
+  // there are never more busy threads than columns
+  bool parallel = false;
+  if (pieces > PARALLEL_DISARRAY_HANDOFF_PIECES) {
+    unsigned int threads = pool_workers(pool_shared()) + 1;
+    if (threads > g->b->width) {
+      threads = g->b->width;
     }
-    if (p.c == c2.c && p.r < c2.r) {
-      current->p.r++;
+    parallel = threads > 1 && (unsigned long long) pieces * (threads - 1) >=
+               (unsigned long long) PARALLEL_DISARRAY_HANDOFF_PIECES * threads;
+  }
+
+  if (parallel) {
+    pool_run(pool_shared(), g->b->width, disarray_columns, g);
+  } else {
+    disarray_columns(g, 0, g->b->width);
+  }
+    
+  disarray_update_queues(g);
+}
+
+void disarray(game* g) {
+  unsigned int* col_height = g->col_height;
+  if (g->lazy) {
+    mark_flipped_columns(g);
+  } else {
+    flip_columns(g);
+  }
+
+  invalidate_if_runs(g);
+  for (unsigned int c = 0; c < g->b->width; c++) {
+    if (col_height[c] > 1) {
+      mark_dirty(g, c, g->b->height - col_height[c], g->b->height - 1);
     }
-    current = current->next;
   }
+
+  g->player = (g->player + 1) % 2;
+}
+
+/* Lets the pieces above an emptied cell fall by one row, from the top of the
+   column's stack down to the emptied cell, and lowers the column height.
+   Only the queue entries of the pieces that fall are moved, found through
+   the index of queue slots.
+
+   @param game* the game that we are updating
+   @param pos the position of the cell that was emptied
+   */
+void collapse_column(game* g, pos p) {
+  unsigned int top = g->b->height - g->col_height[p.c];
+  for (unsigned int r = p.r; r > top; r--) {
+    move_entry(g, make_pos(r - 1, p.c), make_pos(r, p.c));
+  }
+  board_fall(g->b, p, top);
+  g->col_height[p.c]--;
 }
 
+/* Puts back in order the columns holding the two pieces that an offset is
+   about to remove, if a lazy disarray marked them as flipped.
+
+   @param game* the game that the offset is played in
+   @param bool* where to record whether each column was settled, the column
+   of the oldest piece of the mover first, or NULL
+   */
+void settle_offset_columns(game* g, bool* settled) {
+  posqueue* mine = g->player == BLACKS_TURN ? g->black_queue 
+                                            : g->white_queue;
+  posqueue* theirs = g->player == BLACKS_TURN ? g->white_queue 
+                                              : g->black_queue;
+  unsigned int cols[2] = {posqueue_at(mine, 0)->c, 
+                          posqueue_at(theirs, theirs->len - 1)->c};
+  for (unsigned int i = 0; i < 2; i++) {
+    bool settle = g->flipped[cols[i]];
+    if (settle) {
+      settle_column(g, cols[i]);
+    }
+    if (settled) {
+      settled[i] = settle;
+    }
+  }
+}
 
 bool offset(game* g) {
   if (g->white_queue->len == 0 || g->black_queue->len == 0) {
     return false;
   }
+  settle_offset_columns(g, NULL);
 
   pos c1, c2; // cell 1, cell 2
   switch (g->player) {
@@ -207,29 +771,275 @@ bool offset(game* g) {
       break;
   }  
 
-  board_set(g->b, c1, EMPTY);
-  board_set(g->b, c2, EMPTY);
-  
-  
-  for (unsigned int r = c1.r; r > 0; r--) {
-    cell above = board_get(g->b, make_pos(r-1, c1.c));
-    board_set(g->b, make_pos(r, c1.c), above);
-  }
-  board_set(g->b, make_pos(0, c1.c), EMPTY);
-  
-  for (unsigned int r = c2.r; r > 0; r--) {
-    cell above = board_get(g->b, make_pos(r-1, c2.c));
-    board_set(g->b, make_pos(r, c2.c), above);
+  board_set_unchecked(g->b, c1, EMPTY);
+  board_set_unchecked(g->b, c2, EMPTY);
+
+  // When both pieces share a column, the upper one has to fall first, or the
+  // gap it leaves would be carried down over the lower one.
+  pos upper = c1, lower = c2;
+  if (c1.c == c2.c && c2.r < c1.r) {
+    upper = c2;
+    lower = c1;
   }
-  board_set(g->b, make_pos(0, c2.c), EMPTY);
+  collapse_column(g, upper);
+  collapse_column(g, lower);
   
-  offset_update_queue(g->white_queue, c1, c2);
-  offset_update_queue(g->black_queue, c1, c2);
+
+  invalidate_if_runs(g);
+  mark_dirty(g, c1.c, g->b->height - g->col_height[c1.c] - 1, c1.r);
+  mark_dirty(g, c2.c, g->b->height - g->col_height[c2.c] - 1, c2.r);
 
   g->player = (g->player + 1) % 2;
   return true;
 }
 
+/* Takes back the fall of one emptied cell in a column: the pieces between
+   the top of the stack and the cell rise by one row, and the removed piece
+   is put back in the cell. This undoes collapse_column.
+
+   @param game* the game that we are updating
+   @param pos the position of the cell that was emptied
+   @param cell the piece that was removed from the cell
+   */
+void uncollapse_column(game* g, pos p, cell removed) {
+  unsigned int top = g->b->height - g->col_height[p.c];
+  for (unsigned int r = top; r <= p.r; r++) {
+    move_entry(g, make_pos(r, p.c), make_pos(r - 1, p.c));
+  }
+  board_rise(g->b, p, top, removed);
+  g->col_height[p.c]++;
+}
+
+unsigned int legal_moves(game* g, move* moves) {
+  unsigned int n = 0;
+  for (unsigned int c = 0; c < g->b->width; c++) {
+    if (g->col_height[c] < g->b->height) {
+      moves[n].type = MOVE_DROP;
+      moves[n++].column = c;
+    }
+  }
+  if (g->black_queue->len > 0 && g->white_queue->len > 0) {
+    moves[n].type = MOVE_OFFSET;
+    moves[n++].column = 0;
+  }
+  moves[n].type = MOVE_DISARRAY;
+  moves[n++].column = 0;
+  return n;
+}
+
+/* Pushes a record onto the undo stack of a game, growing the stack when it
+   is full.
+
+   @param game* the game whose stack we are pushing onto
+   @param undo the record that we are pushing
+   */
+void push_undo(game* g, undo u) {
+  if (g->undo_len == g->undo_cap) {
+    unsigned int cap = g->undo_cap == 0 ? 64 : 2 * g->undo_cap;
+    undo* stack;
+    if (g->arena) {
+      // the old stack stays in the arena until it is released
+      stack = (undo*) arena_alloc(g->arena, sizeof(undo) * cap, 
+                                  sizeof(uint64_t));
+      if (g->undo_len > 0) {
+        memcpy(stack, g->undo_stack, sizeof(undo) * g->undo_len);
+      }
+    } else {
+      stack = (undo*) realloc (g->undo_stack, sizeof(undo) * cap);
+    }
+    if (!stack) {
+      fprintf(stderr, "game_make_move, unable to grow undo stack\n");
+      exit(1);
+    }
+    g->undo_stack = stack;
+    g->undo_cap = cap;
+  }
+  g->undo_stack[g->undo_len++] = u;
+}
+
+bool game_make_move(game* g, move m) {
+  undo u;
+  u.m = m;
+  u.player = g->player;
+  u.black_runs = g->black_runs;
+  u.white_runs = g->white_runs;
+  u.clean = !g->rescan && g->dirty_len == 0;
+  u.settled[0] = u.settled[1] = false;
+
+  switch (m.type) {
+    case MOVE_DROP:
+      u.settled[0] = m.column < g->b->width && g->flipped[m.column];
+      if (!drop_piece(g, m.column)) {
+        return false;
+      }
+      break;
+    case MOVE_DISARRAY:
+      disarray(g);
+      break;
+    case MOVE_OFFSET: {
+      if (g->white_queue->len == 0 || g->black_queue->len == 0) {
+        return false;
+      }
+      posqueue* mine = g->player == BLACKS_TURN ? g->black_queue 
+                                                : g->white_queue;
+      posqueue* theirs = g->player == BLACKS_TURN ? g->white_queue 
+                                                  : g->black_queue;
+      settle_offset_columns(g, u.settled);
+      u.removed[0] = *posqueue_at(mine, 0);
+      u.removed[1] = *posqueue_at(theirs, theirs->len - 1);
+      offset(g);
+      break;
+    }
+    default:
+      return false;
+  }
+  push_undo(g, u);
+  return true;
+}
+
+bool game_unmake_move(game* g) {
+  if (g->undo_len == 0) {
+    return false;
+  }
+  undo u = g->undo_stack[--(g->undo_len)];
+  posqueue* mine = u.player == BLACKS_TURN ? g->black_queue : g->white_queue;
+  posqueue* theirs = u.player == BLACKS_TURN ? g->white_queue 
+                                             : g->black_queue;
+  cell my_cell = u.player == BLACKS_TURN ? BLACK : WHITE;
+  cell their_cell = u.player == BLACKS_TURN ? WHITE : BLACK;
+
+  switch (u.m.type) {
+    case MOVE_DROP: {
+      pos p = posqueue_remback(mine);
+      board_set_unchecked(g->b, p, EMPTY);
+      g->col_height[p.c]--;
+      if (u.settled[0]) {
+        settle_column(g, p.c);
+      }
+      break;
+    }
+    case MOVE_DISARRAY:
+      if (g->lazy) {
+        mark_flipped_columns(g);
+      } else {
+        flip_columns(g);
+      }
+      break;
+    case MOVE_OFFSET: {
+      // offset let the upper of two pieces in one column fall first, so
+      // the lower one is put back first
+      pos c1 = u.removed[0], c2 = u.removed[1];
+      cell cell1 = my_cell, cell2 = their_cell;
+      if (c1.c == c2.c && c2.r < c1.r) {
+        pos temp_p = c1;
+        c1 = c2;
+        c2 = temp_p;
+        cell1 = their_cell;
+        cell2 = my_cell;
+      }
+      uncollapse_column(g, c2, cell2);
+      uncollapse_column(g, c1, cell1);
+      posqueue_addfront(mine, u.removed[0]);
+      index_oldest(g, mine);
+      pos_enqueue(theirs, u.removed[1]);
+      index_newest(g, theirs);
+      // the columns go back to being marked in the opposite order
+      if (u.settled[1]) {
+        settle_column(g, u.removed[1].c);
+      }
+      if (u.settled[0]) {
+        settle_column(g, u.removed[0].c);
+      }
+      break;
+    }
+  }
+
+  clear_dirty(g);
+  if (u.clean) {
+    g->black_runs = u.black_runs;
+    g->white_runs = u.white_runs;
+    g->rescan = false;
+  } else {
+    g->rescan = true;
+  }
+  g->player = u.player;
+  return true;
+}
+
+/* Finds how many steps can be taken from a cell in one direction along one
+   axis before leaving the board.
+
+   @param unsigned int the row or column of the cell
+   @param unsigned int the height or width of the board
+   @param int the direction of the steps along that axis: -1, 0, or 1
+   @return unsigned int the number of steps that stay on the board
+   */
+unsigned int room(unsigned int at, unsigned int size, int dir) {
+  if (dir > 0) {
+    return size - 1 - at;
+  }
+  if (dir < 0) {
+    return at;
+  }
+  return ~0u;
+}
+
+/* Counts the pieces of one player in a line of cells that starts one step
+   from a given cell, stopping at the first cell that does not hold a piece
+   of the player. The number of cells checked is capped by the caller, which
+   makes sure the line stays on the board. The matrix representation walks
+   the cells with a pointer, since a step in any direction is a fixed 
+   distance in its single block of cells; the others use the unchecked 
+   accessors. While a lazy disarray has columns marked as flipped, every 
+   cell is read through game_cell instead.
+
+   @param game* the game that we are considering
+   @param unsigned int the row of the cell the line starts next to
+   @param unsigned int the column of the cell the line starts next to
+   @param int the direction of the line in the vertical direction
+   @param int the direction of the line in the horizontal direction
+   @param unsigned int the most cells to check
+   @param cell the player whose pieces we are counting
+   @return unsigned int the number of pieces of the player in a row
+   */
+unsigned int count_line(game* g, unsigned int r, unsigned int c, int dir_r,
+                        int dir_c, unsigned int max, cell player) {
+  board* b = g->b;
+  unsigned int count = 0;
+  if (g->flipped_len > 0) {
+    while (count < max) {
+      r += dir_r;
+      c += dir_c;
+      if (game_cell(g, make_pos(r, c)) != player) {
+        break;
+      }
+      count++;
+    }
+    return count;
+  }
+  if (b->type == MATRIX) {
+    const uint8_t* cur = b->u.matrix + (size_t) r * b->stride + c;
+    ptrdiff_t step = (ptrdiff_t) dir_r * b->stride + dir_c;
+    while (count < max) {
+      cur += step;
+      if (*cur != player) {
+        break;
+      }
+      count++;
+    }
+    return count;
+  }
+  while (count < max) {
+    r += dir_r;
+    c += dir_c;
+    if (board_get_unchecked(b, make_pos(r, c)) != player) {
+      break;
+    }
+    count++;
+  }
+  return count;
+}
+
 /* Checks if a run is possible in a game starting at a certain row and column
    index and a given direction. The directions are either vertial, horizontal, 
    diagonal down right, and diagonal down left. 
@@ -245,50 +1055,120 @@ bool offset(game* g) {
    */
 bool check_run(game* g, unsigned int start_r, unsigned int start_c, int dir_r,
                   int dir_c, cell player) {
-  unsigned int count = 0;
+  unsigned int fits = room(start_r, g->b->height, dir_r);
+  unsigned int fits_c = room(start_c, g->b->width, dir_c);
+  if (fits_c < fits) {
+    fits = fits_c;
+  }
+  if (fits < g->run - 1) {
+    return false; // Out of bounds
+  }
+  return count_line(g, start_r, start_c, dir_r, dir_c, g->run - 1, 
+                    player) == g->run - 1;
+}
 
-  for (unsigned int i = 0; i < g->run; i++) {
-    unsigned int r = start_r + i * dir_r;
-    unsigned int c = start_c + i * dir_c;
+/* Counts the pieces of one player in a line that passes through a cell,
+   looking no more than run - 1 cells away in either direction.
 
-    if (r >= g->b->height || c >= g->b->width) {
-      return false; // Out of bounds
-    }
+   @param game* the game that we are considering
+   @param unsigned int the row of the cell
+   @param unsigned int the column of the cell
+   @param int the direction of the line in the vertical direction
+   @param int the direction of the line in the horizontal direction
+   @param cell the player who owns the cell
+   @return bool true if the line through the cell holds a run
+   */
+bool run_through(game* g, unsigned int r, unsigned int c, int dir_r, 
+                   int dir_c, cell player) {
+  unsigned int count = 1;
+  for (int sign = -1; sign <= 1; sign += 2) {
+    unsigned int max = g->run - 1;
+    unsigned int fits = room(r, g->b->height, sign * dir_r);
+    unsigned int fits_c = room(c, g->b->width, sign * dir_c);
+    max = fits < max ? fits : max;
+    max = fits_c < max ? fits_c : max;
+    count += count_line(g, r, c, sign * dir_r, sign * dir_c, max, player);
+  }
+  return count >= g->run;
+}
 
-    if (board_get(g->b, make_pos(r, c)) == player) {
-      count++;
-    } else {
-      break;
+/* Looks for new runs along the lines through every cell changed since the
+   last call to game_outcome, adding them to the runs already found.
+
+   @param game* the game that we are checking
+   */
+void check_dirty(game* g) {
+  for (unsigned int i = 0; i < g->dirty_len; i++) {
+    unsigned int c = g->dirty_cols[i];
+    for (unsigned int r = g->dirty_lo[c]; r <= g->dirty_hi[c]; r++) {
+      cell cur_c = game_cell(g, make_pos(r, c));
+      if (cur_c == EMPTY || (cur_c == BLACK && g->black_runs) ||
+          (cur_c == WHITE && g->white_runs)) {
+        continue;
+      }
+      if (run_through(g, r, c, 0, 1, cur_c) ||
+          run_through(g, r, c, 1, 0, cur_c) ||
+          run_through(g, r, c, 1, 1, cur_c) ||
+          run_through(g, r, c, 1, -1, cur_c)) {
+        if (cur_c == BLACK) {
+          g->black_runs = true;
+        } else {
+          g->white_runs = true;
+        }
+      }
     }
   }
-  return count == g->run;
 }
 
 outcome game_outcome(game* g){
   bool white_runs = false, black_runs = false, none_empty = true;
-  for (unsigned int r = 0; r < g->b->height; r++) {
-    for (unsigned int c = 0; c < g->b->width; c++) {
-      cell cur_c = board_get(g->b, make_pos(r,c));
-      if (cur_c == EMPTY) {
-        none_empty = false;
-        continue;
-      }
-
-      bool made_run = check_run(g, r, c, 1, 1, cur_c);
-      made_run = made_run || check_run(g, r, c, 0, 1, cur_c);
-      made_run = made_run || check_run(g, r, c, 1, 0, cur_c);
-      made_run = made_run || check_run(g, r, c, 1, -1, cur_c);
-      if (made_run){
-        switch (cur_c) {
-          case BLACK:
-            black_runs = true;
-            break;
-          case WHITE:
-            white_runs = true;
+  if (!g->rescan) {
+    check_dirty(g);
+    clear_dirty(g);
+    black_runs = g->black_runs;
+    white_runs = g->white_runs;
+    none_empty = g->black_queue->len + g->white_queue->len ==
+                   g->b->height * g->b->width;
+  } else if (g->b->type == BITBOARD && g->flipped_len == 0) {
+    black_runs = bitboard_has_run(g->b, BLACK, g->run);
+    white_runs = bitboard_has_run(g->b, WHITE, g->run);
+    none_empty = bitboard_full(g->b);
+  } else if (g->b->type == MATRIX && g->b->width <= 64 &&
+             g->flipped_len == 0) {
+    black_runs = matrix_has_run(g->b, BLACK, g->run);
+    white_runs = matrix_has_run(g->b, WHITE, g->run);
+    none_empty = matrix_full(g->b);
+  } else {
+    for (unsigned int r = 0; r < g->b->height; r++) {
+      for (unsigned int c = 0; c < g->b->width; c++) {
+        cell cur_c = game_cell(g, make_pos(r,c));
+        if (cur_c == EMPTY) {
+          none_empty = false;
+          continue;
         }
-      }  
+
+        bool made_run = check_run(g, r, c, 1, 1, cur_c);
+        made_run = made_run || check_run(g, r, c, 0, 1, cur_c);
+        made_run = made_run || check_run(g, r, c, 1, 0, cur_c);
+        made_run = made_run || check_run(g, r, c, 1, -1, cur_c);
+        if (made_run){
+          switch (cur_c) {
+            case BLACK:
+              black_runs = true;
+              break;
+            case WHITE:
+              white_runs = true;
+          }
+        }  
+      }
     }
   }
+  if (g->rescan) {
+    g->black_runs = black_runs;
+    g->white_runs = white_runs;
+    g->rescan = false;
+    clear_dirty(g);
+  }
   if (black_runs && white_runs) {
     return DRAW;
   } else if (black_runs) {
@@ -3,6 +3,7 @@
 
 #include <stdbool.h>
 #include "board.h"
+#include "arena.h"
 
 
 enum turn {
@@ -23,20 +24,79 @@ enum outcome {
 typedef enum outcome outcome;
 
 
+enum move_type {
+    MOVE_DROP,
+    MOVE_DISARRAY,
+    MOVE_OFFSET
+};
+
+typedef enum move_type move_type;
+
+
+struct move {
+    move_type type;
+    unsigned int column;
+};
+
+typedef struct move move;
+
+
+struct undo {
+    move m;
+    turn player;
+    pos removed[2];
+    bool settled[2];
+    bool black_runs, white_runs, clean;
+};
+
+typedef struct undo undo;
+
+
 struct game {
+    size_t size;
+    arena* arena;
     unsigned int run;
     board* b;
     posqueue *black_queue, *white_queue;
     turn player;
+    bool black_runs, white_runs;
+    bool rescan;
+    unsigned int *dirty_lo, *dirty_hi;
+    unsigned int *dirty_cols, dirty_len;
+    unsigned int* col_height;
+    unsigned int* entry_slot;
+    bool lazy;
+    bool* flipped;
+    unsigned int flipped_len;
+    uint64_t flip_key;
+    undo* undo_stack;
+    unsigned int undo_len, undo_cap;
 };
 
 typedef struct game game;
 
+
+struct game_pool {
+    arena* arena;
+    unsigned int run, width, height;
+    enum type type;
+    game** games;
+    unsigned int len, cap;
+};
+
+typedef struct game_pool game_pool;
+
 /* Creates a new game with the specified size and configuration. It also 
    uses the desired data representation. The function raises an error if it 
    is not possible to complete at least one vertical, horizontal, or diagonal 
    run. If it is not, the function raises an error. Also note that the 
-   starting board is an empty board. 
+   starting board is an empty board. The game keeps an index from every 
+   cell to the slot of its piece in the queue of its owner, which lets 
+   offset and disarray move only the queue entries of the pieces they move.
+   The queues must therefore only be changed through the move functions.
+   New games are not lazy (see game_set_lazy). Everything but the undo 
+   stack is held in one block, which starts with the game struct, so that
+   a game can be copied with a single memcpy (see game_copy_into).
 
    @param unsigned int the number of cells in a row to make a run
    @param unsigned int the number of columns the board has
@@ -47,13 +107,119 @@ typedef struct game game;
 game* new_game(unsigned int run, unsigned int width,
                unsigned int height, enum type type);
 
-/* Completely deallocates a given game struct. Note that the function relies
-   on the board_free and posqueue_free functions intensively.
+/* Completely deallocates a given game struct. Since everything but the undo
+   stack lives in the block of the game, this frees two allocations. Games
+   carved from an arena are left alone.
 
    @param game* a pointer to the game that we will deallocate.
    */
 void game_free(game* g);
 
+/* Creates a new game like new_game, but carves its block out of an arena 
+   instead of allocating it, and carves its undo stack from the arena as it
+   grows as well. Such a game is released along with the arena, all at 
+   once, so game_free does nothing for it.
+
+   @param arena* the arena that the game is carved from
+   @param unsigned int the number of cells in a row to make a run
+   @param unsigned int the number of columns the board has
+   @param unsigned int the number of rows the board has
+   @param enum type the type of the representation the board should use
+   @return game* a pointer to the new game that we have constructed.
+   */
+game* new_game_in(arena* a, unsigned int run, unsigned int width,
+                  unsigned int height, enum type type);
+
+/* Creates a copy of a game that can be played on its own. The copy holds the
+   same board, queues, and turn, so it has the same key, but its undo stack
+   starts out empty, so the moves that led to the game cannot be taken back
+   in the copy. The block of the game is copied with one memcpy, after which
+   the pointers of the copy are moved into its own block.
+
+   @param const game* the game that we are copying
+   @return game* a pointer to the copy
+   */
+game* game_clone(const game* g);
+
+/* Overwrites a game with a copy of another, like game_clone but without 
+   allocating, so that one game can be reset to a snapshot over and over.
+   Both games must have the same width, height, and board representation,
+   otherwise an error is raised. The undo stack of the game being 
+   overwritten is kept for reuse, but emptied.
+
+   @param game* the game that we are overwriting
+   @param const game* the game that we are copying
+   */
+void game_copy_into(game* dst, const game* src);
+
+/* Creates a pool of games of one size and configuration, so that a worker
+   that plays many short games can recycle them instead of allocating a 
+   game for each. The pool keeps a free list of games that were handed 
+   back. A pool is not safe to share between threads; each worker should 
+   keep its own.
+
+   @param arena* the arena new games are carved from, or NULL to allocate 
+   them with new_game
+   @param unsigned int the number of cells in a row to make a run
+   @param unsigned int the number of columns the board has
+   @param unsigned int the number of rows the board has
+   @param enum type the type of the representation the board should use
+   @return game_pool* a pointer to the pool that has been created
+   */
+game_pool* game_pool_new(arena* a, unsigned int run, unsigned int width,
+                         unsigned int height, enum type type);
+
+/* Takes an empty game from a pool, reusing one from the free list if there
+   is one and creating one otherwise.
+
+   @param game_pool* the pool that we are taking a game from
+   @return game* an empty game, with black to move
+   */
+game* game_pool_get(game_pool* p);
+
+/* Hands a game back to a pool. The game is reset with game_reset, its lazy
+   disarray is turned off, and it is kept on the free list for 
+   game_pool_get. The game must have come from the same pool.
+
+   @param game_pool* the pool that we are handing the game to
+   @param game* the game that we are handing back
+   */
+void game_pool_put(game_pool* p, game* g);
+
+/* Completely deallocates a pool along with the games on its free list. 
+   Games that were taken and not handed back are left alone.
+
+   @param game_pool* the pool that we are deallocating
+   */
+void game_pool_free(game_pool* p);
+
+/* Empties the board of a game and gives the turn back to black, as if the
+   game had just been created, so that one game can be reused for many 
+   games without allocating. Only the cells of the pieces on the board are
+   cleared, and the undo stack is emptied. Whether the game is lazy does
+   not change.
+
+   @param game* the game that we are resetting
+   */
+void game_reset(game* g);
+
+/* Sets up a game at a given position: the game is reset, then the pieces of
+   each player are placed in the order of their queue, oldest first, and the
+   turn is set. This is how a position is rebuilt from a stored state, since
+   the order of the queues is part of the state. The pieces must sit on top
+   of each other from the bottom of their columns and may not share a cell,
+   otherwise the function raises an error.
+
+   @param game* the game that we are setting up
+   @param pos* the positions of the pieces of black, oldest first
+   @param unsigned int the number of pieces of black
+   @param pos* the positions of the pieces of white, oldest first
+   @param unsigned int the number of pieces of white
+   @param turn the player whose turn it is
+   */
+void game_set_position(game* g, const pos* black, unsigned int black_len,
+                       const pos* white, unsigned int white_len, turn player);
+
 /* Drops a piece belonging to the play whose turn it is in a specified column.
    The piece is placed at the lowest open cell in the column. If the column
    is already full, no changes are made. If the piece is succesfully dropped,
@@ -73,7 +239,10 @@ bool drop_piece(game* g, unsigned int column);
    the game. The function implements this move by flipping the order of the
    pieces in each column. Also note that the positions of the queues has also 
    been updated to reflect each piece's change in position. After the move is
-   completed, the player is changed to reflect the change in turn.
+   completed, the player is changed to reflect the change in turn. When
+   there are enough pieces on the board, the columns are split between the
+   threads of the process-wide worker pool. In a lazy game the columns are
+   only marked as flipped, so the move costs O(width) (see game_set_lazy).
 
    @param game* the game that we are performing the disarray move on
    */
@@ -93,11 +262,130 @@ void disarray(game* g);
 bool offset(game* g);
 
 /* Reports either the outcome of a completed game, or if that game is still
-   in progress based on the current state of the board.
+   in progress based on the current state of the board. The game keeps the
+   runs it found on the previous call along with the cells that moves have
+   changed since then, so only the lines through those cells are examined: a
+   drop costs O(run) rather than a scan of the whole board. A full scan is
+   only needed when a disarray or offset may have broken a run that was
+   already found, or after game_invalidate. Full scans of bitboards and of
+   matrix boards up to 64 columns wide compare whole rows or words at once
+   (see bitboard_has_run and matrix_has_run), unless a lazy disarray has
+   columns marked as flipped.
 
    @param game* the game that we are reporting the state of
    @return outcome the outcome of the game that we are analyzing
    */
 outcome game_outcome(game* g);
 
+/* Lists every legal move of the player whose turn it is: a drop into each
+   column that is not full, in order of column, then an offset if both 
+   players have a piece on the board, then a disarray, which is always legal.
+   The array must have room for at least width + 2 moves. Note that the 
+   function does not check if the game is already over.
+
+   @param game* the game that we are listing the moves of
+   @param move* the array that the moves are written into
+   @return unsigned int the number of moves written
+   */
+unsigned int legal_moves(game* g, move* moves);
+
+/* Plays a move and records what is needed to take it back with 
+   game_unmake_move. The column of the move is only used for drops. Each
+   record holds the move, the player whose turn it was, the two positions an
+   offset removed, the columns marked by a lazy disarray that the move put 
+   back in order, and the runs remembered by game_outcome, so undoing a move
+   does not depend on the size of the board beyond the cells the move 
+   touched. If the move is illegal, nothing is changed or recorded.
+
+   @param game* the game that we are playing the move in
+   @param move the move that we are playing
+   @return bool false if the move is illegal, otherwise true
+   */
+bool game_make_move(game* g, move m);
+
+/* Takes back the last move played with game_make_move, restoring the board,
+   both queues, the column heights, and the turn exactly as they were before
+   the move.
+
+   @param game* the game that we are taking a move back in
+   @return bool false if there is no move to take back, otherwise true
+   */
+bool game_unmake_move(game* g);
+
+/* Finds the 64 bit key of the full state of a game: the pieces on the 
+   board, the order of both queues, and whose turn it is. Equal states always
+   have equal keys, and the queue order is included because it decides which
+   pieces an offset removes. In a lazy game the key also covers which
+   columns are marked as flipped, so equal states may then have different
+   keys, but different states still never share one. Every part of the key
+   is kept up to date as the board and queues change (see cell_key and
+   posqueue_new), so the key is found in constant time and is never
+   recomputed from the board.
+
+   @param game* the game that we are finding the key of
+   @return uint64_t the key of the current state of the game
+   */
+uint64_t game_key(game* g);
+
+/* Discards the runs remembered by game_outcome, so that the next call scans
+   the entire board. This must be called after the board of a game is
+   changed directly through board_set rather than through the move functions.
+
+   @param game* the game whose remembered outcome we are discarding
+   */
+void game_invalidate(game* g);
+
+/* Chooses whether disarray flips the columns of a game lazily. A lazy
+   disarray only marks every column holding two or more pieces as flipped,
+   instead of reversing the cells of the column and moving the queue entries
+   of its pieces. A marked column is stored upside down within its stack of
+   pieces, and is only put back in order when a drop or an offset changes it,
+   or when game_sync is called. Drops, offsets, game_outcome, legal_moves,
+   and taking moves back all see the game exactly as if every disarray had
+   been done in full, but the board and the queues of a lazy game can only 
+   be read directly after game_sync; otherwise game_cell and game_pos must be
+   used. Turning lazy flips off puts every column back in order.
+
+   @param game* the game that we are changing
+   @param bool true to flip lazily, false to flip every column in full
+   */
+void game_set_lazy(game* g, bool lazy);
+
+/* Puts every column that a lazy disarray marked as flipped back in order, so
+   that the board and both queues can be read directly until the next move.
+   The state of the game does not change, but its key may.
+
+   @param game* the game that we are putting in order
+   */
+void game_sync(game* g);
+
+/* Displays the board of a game with board_show, after putting the columns
+   that a lazy disarray marked as flipped back in order with game_sync, so a
+   lazy game is shown exactly as an eager one.
+
+   @param game* the game that we are displaying
+   */
+void game_show(game* g);
+
+/* Finds where a cell of a game is stored. A cell in the stack of pieces of a
+   column marked as flipped is stored at the opposite end of the stack, and
+   every other cell is stored where it is. Since finding the cell twice
+   gives back the first position, this also finds the cell that a stored 
+   position, such as one read from a queue, stands for.
+
+   @param game* the game that the cell belongs to
+   @param pos the position of the cell
+   @return pos the position the cell is stored at
+   */
+pos game_pos(game* g, pos p);
+
+/* Reads a cell of a game, following columns marked as flipped by a lazy 
+   disarray. The position must be on the board.
+
+   @param game* the game that we are reading
+   @param pos the position of the cell
+   @return cell the contents of the cell
+   */
+cell game_cell(game* g, pos p);
+
 #endif /* LOGIC_H */
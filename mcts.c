@@ -0,0 +1,409 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "mcts.h"
+
+/* The exploration constant of UCT. */
+#define MCTS_EXPLORE 1.4
+
+/* The number of playouts between two looks at the clock. */
+#define MCTS_CLOCK_PLAYOUTS 32
+
+/* The most nodes the trees of a player may hold between them, about 128 MB,
+   split evenly between its threads. Once a tree is full its leaves are no
+   longer expanded, but playouts go on from them. Build with
+   -DMCTS_MAX_NODES=N to change the budget. */
+#ifndef MCTS_MAX_NODES
+#define MCTS_MAX_NODES (1u << 22)
+#endif
+
+/* A node of a search tree. The children of a node are stored next to each
+   other, and a node that has not been expanded has no first child, since
+   the root, at index 0, is never a child. Wins are counted for the player
+   who played the move of the node, with a draw counting as half a win. */
+struct node {
+    move m;
+    unsigned int first_child, children;
+    unsigned int visits;
+    double wins;
+};
+
+typedef struct node node;
+
+
+/* The state of one thread of a search: its tree, its copy of the game, and
+   the path from the root to the node being visited. */
+struct tree {
+    node* nodes;
+    unsigned int len, cap;
+    unsigned int max_nodes;    // this tree's share of MCTS_MAX_NODES
+    unsigned int* path;
+    turn* movers;
+    unsigned int path_cap;
+    move* moves;
+    game* g;
+    uint64_t rng;
+    unsigned long long budget, playouts;
+    struct mcts* owner;
+};
+
+typedef struct tree tree;
+
+
+struct mcts {
+    unsigned int threads;
+    uint64_t seed;
+    tree* trees;
+    unsigned int ms;
+    struct timespec start;
+};
+
+mcts* mcts_new(unsigned int threads, uint64_t seed) {
+  if (threads == 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = cpus < 1 ? 1 : (unsigned int) cpus;
+  }
+
+  mcts* res = (mcts*) malloc(sizeof(mcts));
+  if (!res) {
+    fprintf(stderr, "mcts_new, unable to allocate result\n");
+    exit(1);
+  }
+  res->threads = threads;
+  res->seed = seed;
+  res->trees = (tree*) calloc(threads, sizeof(tree));
+  if (!res->trees) {
+    fprintf(stderr, "mcts_new, unable to allocate trees\n");
+    exit(1);
+  }
+  for (unsigned int t = 0; t < threads; t++) {
+    res->trees[t].max_nodes = MCTS_MAX_NODES / threads;
+  }
+  return res;
+}
+
+void mcts_free(mcts* m) {
+  for (unsigned int t = 0; t < m->threads; t++) {
+    free(m->trees[t].nodes);
+    free(m->trees[t].path);
+    free(m->trees[t].movers);
+    free(m->trees[t].moves);
+  }
+  free(m->trees);
+  free(m);
+}
+
+/* Finds the number of seconds that have passed since a search started.
+
+   @param mcts* the player that is searching
+   @return double the seconds since the start of the search
+   */
+double mcts_elapsed(mcts* m) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - m->start.tv_sec) +
+           (now.tv_nsec - m->start.tv_nsec) / 1e9;
+}
+
+/* Advances the splitmix64 generator of a tree and returns its next value.
+
+   @param tree* the tree whose generator we are advancing
+   @return uint64_t the next pseudo-random value
+   */
+uint64_t tree_random(tree* t) {
+  uint64_t x = (t->rng += 0x9E3779B97F4A7C15ULL);
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  return x ^ (x >> 31);
+}
+
+/* Appends the legal moves of the game of a tree as the children of a node,
+   unless the tree is full. The root is always expanded, so every search has
+   a move to return. The tree never grows past its share of the nodes.
+
+   @param tree* the tree that we are growing
+   @param unsigned int the node that we are expanding
+   */
+void expand(tree* t, unsigned int at) {
+  unsigned int n = legal_moves(t->g, t->moves);
+  if (at != 0 && t->len + n > t->max_nodes) {
+    return;
+  }
+  if (t->len + n > t->cap) {
+    unsigned int cap = t->cap ? t->cap : 1024;
+    while (cap < t->len + n) {
+      cap *= 2;
+    }
+    if (cap > t->max_nodes && t->max_nodes >= t->len + n) {
+      cap = t->max_nodes;
+    }
+    node* nodes = (node*) realloc(t->nodes, cap * sizeof(node));
+    if (!nodes) {
+      fprintf(stderr, "expand, unable to grow tree\n");
+      exit(1);
+    }
+    t->nodes = nodes;
+    t->cap = cap;
+  }
+  t->nodes[at].first_child = t->len;
+  t->nodes[at].children = n;
+  for (unsigned int i = 0; i < n; i++) {
+    node* child = &t->nodes[t->len++];
+    child->m = t->moves[i];
+    child->first_child = 0;
+    child->children = 0;
+    child->visits = 0;
+    child->wins = 0;
+  }
+}
+
+/* Empties a tree, leaving only the root, which is expanded right away. The
+   root always holds every legal move, in the order of legal_moves, so the
+   children of the roots of all trees line up.
+
+   @param tree* the tree that we are emptying
+   */
+void reset_tree(tree* t) {
+  if (t->cap == 0) {
+    t->nodes = (node*) malloc(1024 * sizeof(node));
+    if (!t->nodes) {
+      fprintf(stderr, "reset_tree, unable to allocate tree\n");
+      exit(1);
+    }
+    t->cap = 1024;
+  }
+  t->len = 1;
+  t->nodes[0].first_child = 0;
+  t->nodes[0].children = 0;
+  t->nodes[0].visits = 0;
+  t->nodes[0].wins = 0;
+  expand(t, 0);
+}
+
+/* Picks the child of a node to visit next with UCT. A child that was never
+   visited is always picked first, starting the look from a random child so
+   that the first visits are spread out.
+
+   @param tree* the tree the node belongs to
+   @param unsigned int the node whose children we are choosing between
+   @return unsigned int the child that was picked
+   */
+unsigned int select_child(tree* t, unsigned int at) {
+  node* parent = &t->nodes[at];
+  unsigned int first = parent->first_child, n = parent->children;
+  unsigned int offset = tree_random(t) % n;
+  for (unsigned int i = 0; i < n; i++) {
+    unsigned int c = first + (offset + i) % n;
+    if (t->nodes[c].visits == 0) {
+      return c;
+    }
+  }
+
+  double log_visits = log((double) parent->visits);
+  double best_score = -1;
+  unsigned int best = first;
+  for (unsigned int c = first; c < first + n; c++) {
+    node* child = &t->nodes[c];
+    double score = child->wins / child->visits +
+                     MCTS_EXPLORE * sqrt(log_visits / child->visits);
+    if (score > best_score) {
+      best_score = score;
+      best = c;
+    }
+  }
+  return best;
+}
+
+/* Plays random moves in the game of a tree until the game is over or the
+   move limit is reached.
+
+   @param tree* the tree whose game we are playing out
+   @return outcome the outcome, where a game cut off by the limit is a draw
+   */
+outcome playout(tree* t) {
+  game* g = t->g;
+  unsigned int limit = 4 * g->b->width * g->b->height;
+  outcome o = game_outcome(g);
+  for (unsigned int i = 0; o == IN_PROGRESS && i < limit; i++) {
+    unsigned int n = legal_moves(g, t->moves);
+    game_make_move(g, t->moves[tree_random(t) % n]);
+    o = game_outcome(g);
+  }
+  return o == IN_PROGRESS ? DRAW : o;
+}
+
+/* Adds a node to the path being visited, along with the player who played
+   its move.
+
+   @param tree* the tree the node belongs to
+   @param unsigned int the position of the node in the path
+   @param unsigned int the node
+   @param turn the player who played the move of the node
+   */
+void push_path(tree* t, unsigned int depth, unsigned int at, turn mover) {
+  if (depth == t->path_cap) {
+    unsigned int cap = t->path_cap ? 2 * t->path_cap : 64;
+    unsigned int* path = (unsigned int*) realloc(t->path,
+                                                 cap * sizeof(unsigned int));
+    turn* movers = (turn*) realloc(t->movers, cap * sizeof(turn));
+    if (!path || !movers) {
+      fprintf(stderr, "push_path, unable to grow path\n");
+      exit(1);
+    }
+    t->path = path;
+    t->movers = movers;
+    t->path_cap = cap;
+  }
+  t->path[depth] = at;
+  t->movers[depth] = mover;
+}
+
+/* Runs one playout of a tree: walks down from the root with UCT, expands
+   the leaf it reaches, plays the game out from there, adds the result to
+   every node on the path, then takes every move back.
+
+   @param tree* the tree that we are searching
+   */
+void search_once(tree* t) {
+  game* g = t->g;
+  unsigned int base = g->undo_len, depth = 0, at = 0;
+  push_path(t, depth++, 0, g->player);
+
+  outcome o = game_outcome(g);
+  while (o == IN_PROGRESS) {
+    if (t->nodes[at].children == 0) {
+      if (t->nodes[at].visits == 0 && at != 0) {
+        break;
+      }
+      expand(t, at);
+      if (t->nodes[at].children == 0) {
+        break;
+      }
+    }
+    at = select_child(t, at);
+    push_path(t, depth++, at, g->player);
+    game_make_move(g, t->nodes[at].m);
+    o = game_outcome(g);
+  }
+  if (o == IN_PROGRESS) {
+    o = playout(t);
+  }
+
+  for (unsigned int i = 0; i < depth; i++) {
+    node* n = &t->nodes[t->path[i]];
+    n->visits++;
+    if (o == DRAW) {
+      n->wins += 0.5;
+    } else if ((o == BLACK_WIN) == (t->movers[i] == BLACKS_TURN)) {
+      n->wins += 1;
+    }
+  }
+  while (g->undo_len > base) {
+    game_unmake_move(g);
+  }
+  t->playouts++;
+}
+
+/* Runs the playouts of one tree until its budget is spent or the time limit
+   of the search runs out.
+
+   @param void* the tree that we are searching
+   @return void* always NULL
+   */
+void* search_tree(void* a) {
+  tree* t = (tree*) a;
+  mcts* m = t->owner;
+  while (t->budget == 0 || t->playouts < t->budget) {
+    if (m->ms && t->playouts % MCTS_CLOCK_PLAYOUTS == 0 &&
+        mcts_elapsed(m) * 1000 >= m->ms) {
+      break;
+    }
+    search_once(t);
+  }
+  return NULL;
+}
+
+move mcts_search(mcts* m, game* g, unsigned long long playouts,
+                 unsigned int ms, mcts_stats* stats) {
+  if (playouts == 0 && ms == 0) {
+    fprintf(stderr, "mcts_search, a playout or time budget is required\n");
+    exit(1);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &m->start);
+  m->ms = ms;
+  m->seed++;
+
+  for (unsigned int i = 0; i < m->threads; i++) {
+    tree* t = &m->trees[i];
+    t->owner = m;
+    t->g = game_clone(g);
+    game_set_lazy(t->g, true);
+    t->moves = (move*) realloc(t->moves, (g->b->width + 2) * sizeof(move));
+    if (!t->moves) {
+      fprintf(stderr, "mcts_search, unable to allocate moves\n");
+      exit(1);
+    }
+    t->rng = m->seed * 0xD1B54A32D192ED03ULL + i;
+    t->playouts = 0;
+    t->budget = playouts / m->threads + (i < playouts % m->threads);
+    if (playouts && t->budget == 0) {
+      t->budget = 1;
+    }
+    reset_tree(t);
+  }
+
+  pthread_t* workers = (pthread_t*) malloc(m->threads * sizeof(pthread_t));
+  if (!workers) {
+    fprintf(stderr, "mcts_search, unable to allocate threads\n");
+    exit(1);
+  }
+  for (unsigned int i = 1; i < m->threads; i++) {
+    if (pthread_create(&workers[i], NULL, search_tree, &m->trees[i]) != 0) {
+      fprintf(stderr, "mcts_search, unable to start thread\n");
+      exit(1);
+    }
+  }
+  search_tree(&m->trees[0]);
+  for (unsigned int i = 1; i < m->threads; i++) {
+    pthread_join(workers[i], NULL);
+  }
+  free(workers);
+
+  tree* first = &m->trees[0];
+  unsigned int n = first->nodes[0].children;
+  unsigned long long best_visits = 0, total = 0, nodes = 0;
+  double best_wins = 0;
+  move best = first->nodes[first->nodes[0].first_child].m;
+  for (unsigned int c = 0; c < n; c++) {
+    unsigned long long visits = 0;
+    double wins = 0;
+    for (unsigned int i = 0; i < m->threads; i++) {
+      node* child = &m->trees[i].nodes[m->trees[i].nodes[0].first_child + c];
+      visits += child->visits;
+      wins += child->wins;
+    }
+    if (visits > best_visits) {
+      best_visits = visits;
+      best_wins = wins;
+      best = first->nodes[first->nodes[0].first_child + c].m;
+    }
+  }
+  for (unsigned int i = 0; i < m->threads; i++) {
+    total += m->trees[i].playouts;
+    nodes += m->trees[i].len;
+    game_free(m->trees[i].g);
+    m->trees[i].g = NULL;
+  }
+
+  if (stats) {
+    stats->playouts = total;
+    stats->seconds = mcts_elapsed(m);
+    stats->nodes = nodes;
+    stats->value = best_visits ? best_wins / best_visits : 0.5;
+  }
+  return best;
+}
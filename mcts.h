@@ -0,0 +1,67 @@
+#ifndef MCTS_H
+#define MCTS_H
+
+#include <stdint.h>
+#include "logic.h"
+
+
+struct mcts_stats {
+    unsigned long long playouts;
+    double seconds;
+    unsigned long long nodes;
+    double value;
+};
+
+typedef struct mcts_stats mcts_stats;
+
+
+struct mcts;
+
+typedef struct mcts mcts;
+
+/* Creates a Monte Carlo tree search player that searches with a number of
+   threads. Each thread grows a tree of its own from a copy of the game
+   (root parallel search), and the trees are only combined at the root once
+   the search is over, so the threads never wait on each other. The trees
+   share a fixed budget of nodes (MCTS_MAX_NODES in mcts.c, about 128 MB),
+   split evenly between the threads, so more threads do not take more
+   memory. Each tree is emptied at the start of a search and its memory is
+   reused, so a player never holds more than the budget.
+
+   @param unsigned int the number of threads, or 0 for one for every online
+   processor
+   @param uint64_t the seed of the random playouts
+   @return mcts* a pointer to the player that has been created
+   */
+mcts* mcts_new(unsigned int threads, uint64_t seed);
+
+/* Completely deallocates a Monte Carlo tree search player and its trees.
+
+   @param mcts* the player that we are deallocating
+   */
+void mcts_free(mcts* m);
+
+/* Finds a move for the player whose turn it is with Monte Carlo tree search.
+   Moves in the tree are chosen with UCT, leaves are expanded with every
+   legal move, and positions are scored by playing random moves until
+   game_outcome finds the game over (or for four times as many moves as the
+   board has cells, which counts as a draw). The moves are played with
+   game_make_move on lazy copies of the game and taken back with
+   game_unmake_move, so the game itself is not changed. The search stops
+   once the playout budget is spent or the time limit runs out, whichever
+   comes first; at least one must be given. The move whose subtrees were
+   visited most across all threads is returned. The game must be in
+   progress.
+
+   @param mcts* the player that searches
+   @param game* the game that we are searching
+   @param unsigned long long the number of playouts, or 0 for no limit
+   @param unsigned int the time limit in milliseconds, or 0 for no limit
+   @param mcts_stats* where the statistics of the search are stored, or
+   NULL if they are not needed
+   @return move the best move that was found
+   */
+move mcts_search(mcts* m, game* g, unsigned long long playouts,
+                 unsigned int ms, mcts_stats* stats);
+
+#endif /* MCTS_H */
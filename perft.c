@@ -0,0 +1,156 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include "logic.h"
+#include "board.h"
+#include "pos.h"
+#include "step.h"
+
+/* Counts the leaves of the move tree of a game to a fixed depth. Every legal
+   drop, the offset when it is legal, and the disarray are played at every
+   node, including the last ply, so the speed reported is the speed of
+   game_make_move and game_unmake_move. A game that is over has no moves, so
+   it only counts as a leaf when it is reached at the full depth.
+
+   @param game* the game whose tree we are counting
+   @param unsigned int the number of moves left to play
+   @param move* room for the moves of every ply that is left
+   @return unsigned long long the number of leaves
+   */
+unsigned long long perft(game* g, unsigned int depth, move* moves) {
+  if (depth == 0) {
+    return 1;
+  }
+  if (game_outcome(g) != IN_PROGRESS) {
+    return 0;
+  }
+  unsigned int n = legal_moves(g, moves);
+  unsigned long long total = 0;
+  for (unsigned int i = 0; i < n; i++) {
+    game_make_move(g, moves[i]);
+    total += perft(g, depth - 1, moves + g->b->width + 2);
+    game_unmake_move(g);
+  }
+  return total;
+}
+
+/* Counts the move tree of a new game with one board representation and
+   reports the count along with the speed. With divide, the count below each
+   root move is printed as well.
+
+   @param unsigned int the height of the board
+   @param unsigned int the width of the board
+   @param unsigned int the run length
+   @param enum type the board representation
+   @param unsigned int the depth of the tree
+   @param bool whether to print the count of each root move
+   @param bool whether disarray only marks the columns it flips
+   @return unsigned long long the number of leaves
+   */
+unsigned long long run_perft(unsigned int h, unsigned int w, unsigned int r,
+                             enum type type, unsigned int depth,
+                             bool divide, bool lazy) {
+  static const char* names[] = {"matrix", "bits", "bitboard", "columns"};
+  game* g = new_game(r, w, h, type);
+  game_set_lazy(g, lazy);
+  move* moves = (move*) malloc((depth + 1) * (w + 2) * sizeof(move));
+  if (!moves) {
+    fprintf(stderr, "run_perft, unable to allocate moves\n");
+    exit(1);
+  }
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  unsigned long long total = 0;
+  if (divide && depth > 0) {
+    unsigned int n = legal_moves(g, moves);
+    for (unsigned int i = 0; i < n; i++) {
+      game_make_move(g, moves[i]);
+      unsigned long long count = perft(g, depth - 1, moves + w + 2);
+      game_unmake_move(g);
+      printf("%c: %llu\n", move_label(moves[i]), count);
+      total += count;
+    }
+  } else {
+    total = perft(g, depth, moves);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  double seconds = (end.tv_sec - start.tv_sec) +
+                     (end.tv_nsec - start.tv_nsec) / 1e9;
+  printf("%-8s depth %u: %llu nodes in %.3f s (%.0f nodes/sec)\n",
+         names[type], depth, total, seconds,
+         seconds > 0 ? total / seconds : 0.0);
+  free(moves);
+  game_free(g);
+  return total;
+}
+
+/* Counts the move tree from the empty board. Takes the height, width, and
+   run length with -h, -w, and -r as play does, and the depth with -d. The
+   board representation is chosen with -m, -b, -p, or -c; if none is given,
+   every representation is run and the counts must agree. The flag -D
+   prints the count below each root move, and -l plays disarray lazily (see
+   game_set_lazy).
+   */
+int main(int argc, char* argv[]) {
+  int h = 0, w = 0, r = 0, depth = -1;
+  bool types[4] = {false, false, false, false}, any_type = false;
+  bool divide = false, lazy = false;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-h") == 0 && i + 1 < argc) {
+      h = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+      w = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+      r = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+      depth = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-m") == 0) {
+      types[MATRIX] = any_type = true;
+    } else if (strcmp(argv[i], "-b") == 0) {
+      types[BITS] = any_type = true;
+    } else if (strcmp(argv[i], "-p") == 0) {
+      types[BITBOARD] = any_type = true;
+    } else if (strcmp(argv[i], "-c") == 0) {
+      types[COLUMNS] = any_type = true;
+    } else if (strcmp(argv[i], "-D") == 0) {
+      divide = true;
+    } else if (strcmp(argv[i], "-l") == 0) {
+      lazy = true;
+    } else {
+      fprintf(stderr, "usage: %s -h HEIGHT -w WIDTH -r RUN -d DEPTH "
+              "[-m] [-b] [-p] [-c] [-D] [-l]\n", argv[0]);
+      exit(1);
+    }
+  }
+
+  if (h < 1 || w < 1 || r < 1 || depth < 0) {
+    fprintf(stderr, "perft, a height, width, run length, and depth are "
+            "required\n");
+    exit(1);
+  }
+
+  bool first = true, agree = true;
+  unsigned long long expected = 0;
+  for (unsigned int t = MATRIX; t <= COLUMNS; t++) {
+    if (any_type && !types[t]) {
+      continue;
+    }
+    unsigned long long count = run_perft(h, w, r, t, depth, divide, lazy);
+    if (first) {
+      expected = count;
+      first = false;
+    } else if (count != expected) {
+      agree = false;
+    }
+  }
+
+  if (!agree) {
+    fprintf(stderr, "perft, the board representations disagree\n");
+    exit(1);
+  }
+  return 0;
+}
@@ -2,22 +2,72 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
+#include <unistd.h>
 #include "logic.h"
 #include "board.h"
 #include "pos.h"
+#include "engine.h"
+#include "mcts.h"
+#include "solvedb.h"
+#include "record.h"
+#include "step.h"
+#include "batch.h"
+
+
+struct options {
+    bool engine_black, engine_white;
+    bool mcts_black, mcts_white;
+    unsigned int depth, ms;
+    unsigned int playouts, threads;
+    char* db;
+    char* record;
+    char *moves, *move_file;
+    bool verbose;
+    bool ansi;
+};
+
+typedef struct options options;
 
 /* Creates the game according to the specifications provided in the command
-   line. Requires three command line arguments: height, width, and run length. 
+   line. Requires three command line arguments: height, width, and run length.
    These can be passed in any order, as long as they are properly labled with
-   -h, -w, and -r. If the width value would result in ? column label(s), or if
-   the arguments are not correct, an error message is raised. 
+   -h, -w, and -r. The board representation is chosen with -m (matrix), -b
+   (bits), -p (one bitboard per player), or -c (bits packed by column). If the
+   width value would result in ? column label(s), or if the arguments are not
+   correct, an error message is raised. The optional flag -e b, -e w, or -e bw
+   hands black, white, or both players to the engine, which searches -d moves
+   deep (6 by default) for at most -t milliseconds per move (no limit by
+   default). The flag -u b, -u w, or -u bw hands players to Monte Carlo tree
+   search instead, which runs -n playouts per move (20000 by default, or no
+   limit when -t is given) on -j threads (every processor by default), stopping
+   early once -t milliseconds have passed. The flag -s FILE maps a database
+   written by solve, which the engine plays from and which is used to report the
+   value of each position under perfect play. The flag -R FILE appends the moves
+   of the game to a record file (see record.h). The flag -M MOVES or -F FILE
+   plays a whole game from a string or a file of moves (- for standard input)
+   instead of asking for them (see run_batch), and -v then reports every move.
+   The flag -a redraws only the cells that changed on an ANSI terminal instead
+   of printing the whole board before every move.
 
    @param int the number of arguments that are provided
    @param char** the array of arguments.  
+   @param options* where the engine options are stored
    @return game* the game that is created from the command line arguments
    */
-game* construct_game(int argc, char* argv[]) {
-  if (argc != 8) {
+game* construct_game(int argc, char* argv[], options* opts) {
+  opts->engine_black = opts->engine_white = false;
+  opts->mcts_black = opts->mcts_white = false;
+  opts->depth = 6;
+  opts->ms = 0;
+  opts->playouts = 0;
+  opts->threads = 0;
+  opts->db = NULL;
+  opts->record = NULL;
+  opts->moves = NULL;
+  opts->move_file = NULL;
+  opts->verbose = false;
+  opts->ansi = false;
+  if (argc < 8) {
     printf("The incorrect number of arguments were provided. Please start" 
                 "a new game with the proper flags and values.\n");
     exit(1);
@@ -42,7 +92,41 @@ game* construct_game(int argc, char* argv[]) {
     } else if (strcmp(argv[i], "-b") == 0) {
       b = BITS;
       b_flag = true;
-    }else {
+    } else if (strcmp(argv[i], "-p") == 0) {
+      b = BITBOARD;
+      b_flag = true;
+    } else if (strcmp(argv[i], "-c") == 0) {
+      b = COLUMNS;
+      b_flag = true;
+    } else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc) {
+      i++;
+      opts->engine_black = strchr(argv[i], 'b') != NULL;
+      opts->engine_white = strchr(argv[i], 'w') != NULL;
+    } else if (strcmp(argv[i], "-u") == 0 && i + 1 < argc) {
+      i++;
+      opts->mcts_black = strchr(argv[i], 'b') != NULL;
+      opts->mcts_white = strchr(argv[i], 'w') != NULL;
+    } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+      opts->playouts = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+      opts->threads = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+      opts->depth = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+      opts->ms = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+      opts->db = argv[++i];
+    } else if (strcmp(argv[i], "-R") == 0 && i + 1 < argc) {
+      opts->record = argv[++i];
+    } else if (strcmp(argv[i], "-M") == 0 && i + 1 < argc) {
+      opts->moves = argv[++i];
+    } else if (strcmp(argv[i], "-F") == 0 && i + 1 < argc) {
+      opts->move_file = argv[++i];
+    } else if (strcmp(argv[i], "-v") == 0) {
+      opts->verbose = true;
+    } else if (strcmp(argv[i], "-a") == 0) {
+      opts->ansi = true;
+    } else {
       printf("An invalid flag or argument was provided. Please start"
             " a new game with the valid arguments.\n");
       exit(1);
@@ -55,6 +139,29 @@ game* construct_game(int argc, char* argv[]) {
     exit(1);
   }
 
+  if (opts->depth < 1) {
+    printf("The engine must search at least one move deep. Please start a "
+        "new game with a valid depth.\n");
+    exit(1);
+  }
+
+  if ((opts->mcts_black && opts->engine_black) ||
+      (opts->mcts_white && opts->engine_white)) {
+    printf("A player may not be given to both engines. Please start a new "
+        "game with valid arguments.\n");
+    exit(1);
+  }
+  if ((opts->moves || opts->move_file) &&
+      (opts->engine_black || opts->engine_white || opts->mcts_black ||
+       opts->mcts_white || (opts->moves && opts->move_file))) {
+    printf("A game played from a list of moves takes every move from the "
+        "one list. Please start a new game with valid arguments.\n");
+    exit(1);
+  }
+  if (opts->playouts == 0 && opts->ms == 0) {
+    opts->playouts = 20000;
+  }
+
   if (h < 1 || w < 1 || r < 1) {
     printf("Unplayable values for either the height, width, "
         "or run length were provided. Please start a new game with valid"
@@ -72,23 +179,87 @@ game* construct_game(int argc, char* argv[]) {
   return res;
 }
 
-/* Attempts to drop a piece in a given game and in a given column. If the drop
-   was succesful, the function returns true. Otherwise, the function informs 
-   the player and returns false. 
-   
-   @param game* the given game that we are dropping in
-   @param char the column that we are dropping a piece in
-   @param char the label of the column that is dropped, used for error 
-   messaging
-   @return bool if the drop was sucessful 
+/* Explains to the player why a move they entered was not played.
+
+   @param step_result the result of the step, other than STEP_PLAYED
+   @param move the move that was entered, if it is a move
+   @param char the character that was entered
+   */
+void report_step(step_result result, move m, char input) {
+  if (result == STEP_INVALID) {
+    printf("That is an invalid input, please try again.");
+  } else if (m.type == MOVE_OFFSET) {
+    printf("An offset move is not possible with the current board. "
+              "Please enter a new input and try again.\n");
+  } else {
+    printf("You may not drop a piece in column %c. Please enter a new "
+              "move and try again.\n", input);
+  }
+}
+
+/* Lets the engine choose and play the move of the player whose turn it is,
+   then reports the move along with the speed of the search.
+
+   @param game* the game that the engine is playing in
+   @param engine* the engine that searches for the move
+   @param options* the depth and time limit of the search
+   @return move the move that was played
+   */
+move engine_move(game* g, engine* e, options* opts) {
+  engine_stats stats;
+  move m = engine_search(e, g, opts->depth, opts->ms, &stats);
+  char label = move_label(m);
+  printf("%s plays %c (depth %u, %llu nodes, %.0f nodes/sec)\n",
+         g->player == BLACKS_TURN ? "Black" : "White", label, stats.depth,
+         stats.nodes, stats.seconds > 0 ? stats.nodes / stats.seconds : 0.0);
+  game_make_move(g, m);
+  return m;
+}
+
+/* Lets Monte Carlo tree search choose and play the move of the player whose
+   turn it is, then reports the move along with the speed of the search.
+
+   @param game* the game that the search is playing in
+   @param mcts* the player that searches for the move
+   @param options* the playout budget and time limit of the search
+   @return move the move that was played
+   */
+move mcts_move(game* g, mcts* m, options* opts) {
+  mcts_stats stats;
+  move best = mcts_search(m, g, opts->playouts, opts->ms, &stats);
+  char label = move_label(best);
+  printf("%s plays %c (%llu playouts, %.0f playouts/sec, %.0f%% expected)\n",
+         g->player == BLACKS_TURN ? "Black" : "White", label, stats.playouts,
+         stats.seconds > 0 ? stats.playouts / stats.seconds : 0.0,
+         100 * stats.value);
+  game_make_move(g, best);
+  return best;
+}
+
+/* Reports the value of the position of a game under perfect play, if the
+   position is in the database.
+
+   @param game* the game whose position is reported
+   @param solvedb* the database that we are looking in
    */
-bool try_drop(game* g, char col, char input) {
-  if (drop_piece(g, col)) {
-    return true;
-  } 
-  printf("You may not drop a piece in column %c. Please enter a new "
-            "move and try again.\n", input);
-  return false;
+void show_solved(game* g, solvedb* db) {
+  solved value;
+  if (!solvedb_lookup(db, g, &value) ||
+      (value.result != SOLVED_DRAW && value.distance == 0)) {
+    return;
+  }
+  const char* mover = g->player == BLACKS_TURN ? "black" : "white";
+  const char* other = g->player == BLACKS_TURN ? "white" : "black";
+  switch (value.result) {
+    case SOLVED_WIN:
+      printf("Perfect play: win for %s in %u moves\n", mover, value.distance);
+      break;
+    case SOLVED_LOSS:
+      printf("Perfect play: win for %s in %u moves\n", other, value.distance);
+      break;
+    default:
+      printf("Perfect play: draw\n");
+  }
 }
 
 /* Runs the main loop in the game. The game runs until an result is reached or
@@ -96,13 +267,65 @@ bool try_drop(game* g, char col, char input) {
    corrected with a new input. 
 
     @param game* the game that has been created
+    @param options* which players the engine controls, and how it searches
    */
-void main_loop(game* g) {
+void main_loop(game* g, options* opts) {
+  engine* e = NULL;
+  if (opts->engine_black || opts->engine_white) {
+    e = engine_new(20);
+  }
+  mcts* m = NULL;
+  if (opts->mcts_black || opts->mcts_white) {
+    m = mcts_new(opts->threads, 1);
+  }
+  solvedb* db = NULL;
+  if (opts->db) {
+    db = solvedb_open(opts->db);
+    const solvedb_header* info = solvedb_info(db);
+    if (info->run != g->run || info->width != g->b->width ||
+        info->height != g->b->height) {
+      printf("The database was solved for a different board and will not "
+          "be used.\n");
+      solvedb_close(db);
+      db = NULL;
+    }
+    if (e && db) {
+      engine_use_db(e, db);
+    }
+  }
+  record_writer* rec = NULL;
+  if (opts->record) {
+    rec = record_writer_open(opts->record, g->run, g->b->width,
+                             g->b->height, g->b->type);
+  }
+  board_view* view = NULL;
+  if (opts->ansi) {
+    view = board_view_new(g->b->width, g->b->height, STDOUT_FILENO);
+  }
   while (true) {
-    board_show(g->b);
+    if (view) {
+      fflush(stdout);
+      game_sync(g);
+      board_view_draw(view, g->b);
+    } else {
+      game_show(g);
+    }
+    if (db) {
+      show_solved(g, db);
+    }
     
     char input;
     bool invalid_input = true;
+    move played = {MOVE_DISARRAY, 0};
+    if ((g->player == BLACKS_TURN && opts->engine_black) ||
+        (g->player == WHITES_TURN && opts->engine_white)) {
+      played = engine_move(g, e, opts);
+      invalid_input = false;
+    } else if ((g->player == BLACKS_TURN && opts->mcts_black) ||
+               (g->player == WHITES_TURN && opts->mcts_white)) {
+      played = mcts_move(g, m, opts);
+      invalid_input = false;
+    }
     while (invalid_input) {
       switch (g->player) {
         case BLACKS_TURN:
@@ -114,31 +337,16 @@ void main_loop(game* g) {
 
       scanf("%c%*c", &input);
 
-      if(input == '!' ) {
-        if (offset(g)){
-          invalid_input = false;
-        } else {
-          printf("An offset move is not possible with the current board. "
-                    "Please enter a new input and try again.\n");
-        }
-
-      } else if (input == '^') {
-        disarray(g);
-        invalid_input = false;
-
-      } else if ('0' <= input && input <= '9') {
-        invalid_input = !try_drop(g, input - '0', input);
-
-      } else if ('A' <= input && input <= 'Z') {
-        invalid_input = !try_drop(g, 10 + input - 'A', input);
-
-      } else if ('a' <= input && input <= 'z') {
-        invalid_input = !try_drop(g, 36 + input - 'a', input); 
-      } else {
-        printf("That is an invalid input, please try again."); 
+      step_result result = game_step(g, input, &played);
+      invalid_input = result != STEP_PLAYED;
+      if (invalid_input) {
+        report_step(result, played, input);
       }
     }
     
+    if (rec) {
+      record_move(rec, played);
+    }
     printf("\n\n");
     
 
@@ -159,17 +367,51 @@ void main_loop(game* g) {
 
     printf("Game over! The game has resulted in a %s!\n", game_state);
     printf("The final state of the board is as follows: \n");
-    board_show(g->b);
+    game_show(g);
     printf("\n");
     printf("Thank you for completing a game of Topsy-Turvy. If you wish, "
                 "please play again! \n");
+    if (e) {
+      engine_free(e);
+    }
+    if (m) {
+      mcts_free(m);
+    }
+    if (db) {
+      solvedb_close(db);
+    }
+    if (rec) {
+      record_writer_close(rec);
+    }
+    if (view) {
+      board_view_free(view);
+    }
     game_free(g);
     exit(1);
   }
 }
 
 int main(int argc, char* argv[]) {
-  game* g = construct_game(argc, argv);
+  options opts;
+  game* g = construct_game(argc, argv, &opts);
+
+  if (opts.moves || opts.move_file) {
+    char* moves = opts.moves ? opts.moves : read_moves(opts.move_file);
+    record_writer* rec = NULL;
+    if (opts.record) {
+      rec = record_writer_open(opts.record, g->run, g->b->width,
+                               g->b->height, g->b->type);
+    }
+    int status = run_batch(g, moves, opts.verbose, rec);
+    if (rec) {
+      record_writer_close(rec);
+    }
+    if (!opts.moves) {
+      free(moves);
+    }
+    game_free(g);
+    return status;
+  }
 
   printf("Welcome to Topsy-Turvy!\n");
   printf("The objective of the game is to complete a line of %u pieces in "
@@ -189,5 +431,5 @@ int main(int argc, char* argv[]) {
   printf("Black will start first. Please enter any character to start: ");
   scanf("%c", &input);
 
-  main_loop(g);
+  main_loop(g, &opts);
 }
@@ -0,0 +1,195 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "pool.h"
+
+struct pool {
+  pthread_t* threads;
+  unsigned int workers;
+
+  pthread_mutex_t busy;  // held by the caller whose job is running
+
+  pthread_mutex_t lock;  // guards everything below
+  pthread_cond_t start, done;
+  unsigned long generation;
+  unsigned int pending;
+  bool stop;
+  pool_task task;
+  void* arg;
+  unsigned int n;
+};
+
+struct worker_args {
+  pool* p;
+  unsigned int id;
+};
+
+/* Finds the start of a chunk of the range [0, n) when it is split into a 
+   number of nearly equal parts.
+
+   @param unsigned int the number of items in the range
+   @param unsigned int the chunk we are locating
+   @param unsigned int the number of chunks
+   @return unsigned int the first item of the chunk
+   */
+unsigned int chunk_start(unsigned int n, unsigned int k, unsigned int parts) {
+  return (unsigned int) ((unsigned long long) n * k / parts);
+}
+
+/* The loop run by each worker thread. A worker sleeps until the generation
+   of the pool changes, runs its chunk of the new job, and reports back. The
+   worker with id i runs chunk i + 1, since chunk 0 belongs to the caller.
+
+   @param void* the worker_args of this worker, freed by the worker
+   @return void* returns NULL always
+   */
+void* pool_worker(void* a) {
+  struct worker_args* args = (struct worker_args*) a;
+  pool* p = args->p;
+  unsigned int chunk = args->id + 1;
+  free(args);
+
+  // a job may be handed out before this thread first takes the lock, so the
+  // generation seen is the one the pool started with
+  unsigned long seen = 0;
+  pthread_mutex_lock(&p->lock);
+  while (true) {
+    while (!p->stop && p->generation == seen) {
+      pthread_cond_wait(&p->start, &p->lock);
+    }
+    if (p->stop) {
+      break;
+    }
+    seen = p->generation;
+    pool_task task = p->task;
+    void* arg = p->arg;
+    unsigned int parts = p->workers + 1;
+    unsigned int lo = chunk_start(p->n, chunk, parts);
+    unsigned int hi = chunk_start(p->n, chunk + 1, parts);
+    pthread_mutex_unlock(&p->lock);
+
+    if (lo < hi) {
+      task(arg, lo, hi);
+    }
+
+    pthread_mutex_lock(&p->lock);
+    if (--(p->pending) == 0) {
+      pthread_cond_signal(&p->done);
+    }
+  }
+  pthread_mutex_unlock(&p->lock);
+  return NULL;
+}
+
+pool* pool_new(unsigned int workers) {
+  pool* res = (pool*) malloc (sizeof(pool));
+  if (!res) {
+    fprintf(stderr, "pool_new, unable to allocate result\n");
+    exit(1);
+  }
+  res->threads = (pthread_t*) malloc (sizeof(pthread_t) * (workers + 1));
+  if (!res->threads) {
+    fprintf(stderr, "pool_new, unable to allocate threads\n");
+    exit(1);
+  }
+  res->workers = workers;
+  res->generation = 0;
+  res->pending = 0;
+  res->stop = false;
+  res->task = NULL;
+  res->arg = NULL;
+  res->n = 0;
+  pthread_mutex_init(&res->busy, NULL);
+  pthread_mutex_init(&res->lock, NULL);
+  pthread_cond_init(&res->start, NULL);
+  pthread_cond_init(&res->done, NULL);
+
+  for (unsigned int i = 0; i < workers; i++) {
+    struct worker_args* args = (struct worker_args*) malloc 
+                                          (sizeof(struct worker_args));
+    if (!args) {
+      fprintf(stderr, "pool_new, unable to allocate worker arguments\n");
+      exit(1);
+    }
+    args->p = res;
+    args->id = i;
+    if (pthread_create(&res->threads[i], NULL, pool_worker, args) != 0) {
+      fprintf(stderr, "pool_new, unable to start worker thread\n");
+      exit(1);
+    }
+  }
+  return res;
+}
+
+void pool_free(pool* p) {
+  if (p == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&p->lock);
+  p->stop = true;
+  pthread_cond_broadcast(&p->start);
+  pthread_mutex_unlock(&p->lock);
+
+  for (unsigned int i = 0; i < p->workers; i++) {
+    pthread_join(p->threads[i], NULL);
+  }
+  pthread_mutex_destroy(&p->busy);
+  pthread_mutex_destroy(&p->lock);
+  pthread_cond_destroy(&p->start);
+  pthread_cond_destroy(&p->done);
+  free(p->threads);
+  free(p);
+}
+
+static pool* shared = NULL;
+static pthread_once_t shared_once = PTHREAD_ONCE_INIT;
+
+/* Creates the process-wide pool. Called exactly once through pthread_once.
+   */
+void shared_init() {
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  if (cpus < 1) {
+    cpus = 1;
+  }
+  shared = pool_new((unsigned int) cpus - 1);
+}
+
+pool* pool_shared() {
+  pthread_once(&shared_once, shared_init);
+  return shared;
+}
+
+unsigned int pool_workers(pool* p) {
+  return p ? p->workers : 0;
+}
+
+void pool_run(pool* p, unsigned int n, pool_task task, void* arg) {
+  if (p == NULL || p->workers == 0 || n < 2 || 
+      pthread_mutex_trylock(&p->busy) != 0) {
+    task(arg, 0, n);
+    return;
+  }
+
+  pthread_mutex_lock(&p->lock);
+  p->task = task;
+  p->arg = arg;
+  p->n = n;
+  p->pending = p->workers;
+  p->generation++;
+  pthread_cond_broadcast(&p->start);
+  pthread_mutex_unlock(&p->lock);
+
+  unsigned int hi = chunk_start(n, 1, p->workers + 1);
+  if (hi > 0) {
+    task(arg, 0, hi);
+  }
+
+  pthread_mutex_lock(&p->lock);
+  while (p->pending > 0) {
+    pthread_cond_wait(&p->done, &p->lock);
+  }
+  pthread_mutex_unlock(&p->lock);
+  pthread_mutex_unlock(&p->busy);
+}
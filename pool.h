@@ -0,0 +1,59 @@
+#ifndef POOL_H
+#define POOL_H
+
+/* A task that can be handed to a pool. The pool calls it with the argument
+   it was given and a half-open range [lo, hi) of the items to work on. */
+typedef void (*pool_task)(void* arg, unsigned int lo, unsigned int hi);
+
+
+struct pool;
+
+typedef struct pool pool;
+
+/* Creates a pool with a fixed number of worker threads. The threads are 
+   started right away and sleep until a job is handed to them with pool_run.
+   A pool with zero workers is valid; every job then runs on the calling
+   thread.
+
+   @param unsigned int the number of worker threads to start
+   @return pool* a pointer to the pool that has been created
+   */
+pool* pool_new(unsigned int workers);
+
+/* Stops the worker threads of a pool and deallocates it. No job may be 
+   running on the pool when it is freed.
+
+   @param pool* the pool that we are deallocating
+   */
+void pool_free(pool* p);
+
+/* Returns the pool shared by the whole process. It is created the first time
+   it is requested, with one worker for every online processor besides the
+   one the caller runs on, and it lives until the process exits.
+
+   @return pool* the process-wide pool
+   */
+pool* pool_shared();
+
+/* Finds the number of worker threads of a pool, not counting the thread
+   that calls pool_run.
+
+   @param pool* the pool, which may be NULL
+   @return unsigned int the number of workers, or 0 if the pool is NULL
+   */
+unsigned int pool_workers(pool* p);
+
+/* Runs a task over the items [0, n), splitting them into contiguous chunks,
+   one for each worker and one for the calling thread, and returns once every
+   chunk is done. If the pool is NULL, has no workers, or is already running
+   a job for another thread, the whole range is run on the calling thread
+   instead, so callers never wait on each other.
+
+   @param pool* the pool that runs the task
+   @param unsigned int the number of items to work on
+   @param pool_task the task to run on each chunk
+   @param void* the argument passed to every call of the task
+   */
+void pool_run(pool* p, unsigned int n, pool_task task, void* arg);
+
+#endif /* POOL_H */
@@ -7,87 +7,148 @@ pos make_pos(unsigned int r, unsigned int c){
   return res;
 }
 
+uint64_t pos_key(pos p){
+  // the splitmix64 finalizer, applied to the row and column
+  uint64_t x = ((uint64_t) p.r << 32 | p.c) + 0x9E3779B97F4A7C15ULL;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  return x ^ (x >> 31);
+}
+
 posqueue* posqueue_new(){
   posqueue* res = (posqueue*) malloc (sizeof(posqueue));
   if(!res) {
     fprintf(stderr, "posqueue_new, unable to allocate result\n");
     exit(1);
   }
-  res->head = NULL;
-  res->tail = NULL;
+  res->entries = NULL;
+  res->head = 0;
   res->len = 0;
+  res->cap = 0;
+  res->sum = 0;
+  res->key = 0;
   return res;
 }
 
+void posqueue_init(posqueue* q, pos* entries, unsigned int cap){
+  q->entries = entries;
+  q->head = 0;
+  q->len = 0;
+  q->cap = cap;
+  q->sum = 0;
+  q->key = 0;
+}
+
 void posqueue_free(posqueue* q){
   if(q == NULL){
     return;
   }
 
-  while (q->head) {
-    pq_entry* temp = q->head->next;
-    free(q->head);
-    q->head = temp;
-  }
+  free(q->entries);
+  free(q);
 }
 
-void pos_enqueue(posqueue* q, pos p){
-  pq_entry* entry = (pq_entry*) malloc (sizeof(pq_entry));
-  if(!entry) {
-    fprintf(stderr, "pos_enqueue, unable to allocate result\n");
+void posqueue_reserve(posqueue* q, unsigned int cap){
+  if (cap <= q->cap) {
+    return;
+  }
+  pos* entries = (pos*) malloc (sizeof(pos) * cap);
+  if(!entries) {
+    fprintf(stderr, "posqueue_reserve, unable to allocate entries\n");
     exit(1);
   }
-  entry->p = p;
-  entry->next = NULL;
-
-  if (q->len == 0) {
-    entry->prev = NULL;
-    q->head = entry;
-  } else {
-    entry->prev = q->tail;
-    q->tail->next = entry;
+  // unwrap the queue so that the oldest position is at index 0
+  for (unsigned int i = 0; i < q->len; i++) {
+    entries[i] = *posqueue_at(q, i);
   }
+  free(q->entries);
+  q->entries = entries;
+  q->head = 0;
+  q->cap = cap;
+}
 
-  q->tail = entry;
+/* Finds the index in the array of a queue of the position at a given place in
+   the queue, wrapping around the end of the array.
+
+   @param posqueue* the queue that we are looking in
+   @param unsigned int the place in the queue, at most the capacity
+   @return unsigned int the index into the entries array
+   */
+unsigned int slot(posqueue* q, unsigned int i){
+  unsigned int s = q->head + i;
+  return s >= q->cap ? s - q->cap : s;
+}
+
+void pos_enqueue(posqueue* q, pos p){
+  if (q->len == q->cap) {
+    posqueue_reserve(q, q->cap == 0 ? 8 : 2 * q->cap);
+  }
+  q->entries[slot(q, q->len)] = p;
   (q->len)++;
+  q->sum += pos_key(p);
+  q->key += q->len * pos_key(p);
 }
 
 pos pos_dequeue(posqueue* q){
-  if(q == NULL || q->len == 0 || q->head == NULL || q->tail == NULL){
+  if(q == NULL || q->len == 0){
     fprintf(stderr, "pos_dequeue, cannot dequeue from empty list\n");
     exit(1);
   }
-  pq_entry* first_entry = q->head;
-  q->head = q->head->next;
-  
-  if (q->head) {
-    q->head->prev = NULL;
-  } else {
-    q->tail = NULL; // When len == 1 and removing an element empties the queue
-  }
-
+  pos res = q->entries[q->head];
+  q->head = slot(q, 1);
   (q->len)--;
-  pos res = first_entry->p;
-  free(first_entry);
+  q->key -= q->sum;
+  q->sum -= pos_key(res);
   return res;
 }
 
+void posqueue_addfront(posqueue* q, pos p){
+  if (q->len == q->cap) {
+    posqueue_reserve(q, q->cap == 0 ? 8 : 2 * q->cap);
+  }
+  q->head = q->head == 0 ? q->cap - 1 : q->head - 1;
+  q->entries[q->head] = p;
+  (q->len)++;
+  q->sum += pos_key(p);
+  q->key += q->sum;
+}
+
 pos posqueue_remback(posqueue* q){
-  if(q == NULL || q->len == 0 || q->head == NULL || q->tail == NULL){
+  if(q == NULL || q->len == 0){
     fprintf(stderr, "posqueue_remback, cannot remove from empty list\n");
     exit(1);
   }
-  pq_entry* last_entry = q->tail;
-  q->tail = q->tail->prev;
+  pos res = q->entries[slot(q, q->len - 1)];
+  q->key -= q->len * pos_key(res);
+  q->sum -= pos_key(res);
+  (q->len)--;
+  return res;
+}
+
+pos* posqueue_at(posqueue* q, unsigned int i){
+  if(q == NULL || i >= q->len){
+    fprintf(stderr, "posqueue_at, index is not within the queue\n");
+    exit(1);
+  }
+  return &q->entries[slot(q, i)];
+}
 
-  if (q->tail) {
-    q->tail->next = NULL;
-  } else {
-    q->head = NULL; // Queue is now empty
+unsigned int posqueue_slot(posqueue* q, unsigned int i){
+  if(q == NULL || i >= q->len){
+    fprintf(stderr, "posqueue_slot, index is not within the queue\n");
+    exit(1);
   }
+  return slot(q, i);
+}
 
-  (q->len)--;
-  pos res = last_entry->p;
-  free(last_entry);
-  return res;
+unsigned int posqueue_place(posqueue* q, unsigned int s){
+  return s >= q->head ? s - q->head : s + q->cap - q->head;
+}
+
+void posqueue_set(posqueue* q, unsigned int i, pos p){
+  pos* current = posqueue_at(q, i);
+  uint64_t change = pos_key(p) - pos_key(*current);
+  q->sum += change;
+  q->key += (i + 1) * change;
+  *current = p;
 }
@@ -1,6 +1,8 @@
 #ifndef POS_H
 #define POS_H
 
+#include <stdint.h>
+
 struct pos {
     unsigned int r, c;
 };
@@ -8,17 +10,10 @@ struct pos {
 typedef struct pos pos;
 
 
-typedef struct pq_entry pq_entry;
-
-struct pq_entry {
-    pos p;
-    pq_entry *next, *prev;
-};
-
-
 struct posqueue {
-    pq_entry *head, *tail;
-    unsigned int len;
+    pos* entries;
+    unsigned int head, len, cap;
+    uint64_t sum, key;
 };
 
 typedef struct posqueue posqueue;
@@ -34,17 +29,55 @@ typedef struct posqueue posqueue;
    */
 pos make_pos(unsigned int r, unsigned int c);
 
-/* Allocates a new empty queue and returns its pointer. Note that the fields 
-   of the empty struct are set to NULL, NULL, and 0 for the head pointer, 
-   tail pointer, and length of list respectively. 
+/* Finds a pseudo-random 64 bit key for a position, used to build the 
+   Zobrist keys of boards and queues. The same position always has the same
+   key.
+
+   @param pos the position that we are finding the key of
+   @return uint64_t the key of the position
+   */
+uint64_t pos_key(pos p);
+
+/* Allocates a new empty queue and returns its pointer. The positions of the
+   queue are kept in a single circular array: head is the index of the oldest
+   position within entries, len is the number of positions held, and cap is
+   the size of the array. The array grows by doubling when it is full. 
+   
+   The queue also keeps a key that depends on the order of its positions: 
+   key is the sum of the key of each position times its place in the queue, 
+   counting from 1 at the oldest, and sum is the plain sum of the keys. Both
+   are updated in constant time by every function below, including the 
+   dequeue, since removing the oldest position lowers the place of every 
+   other position by one, which takes sum away from key.
 
    @return posqueue* new, empty, queue of positions
    */
 posqueue* posqueue_new();
 
-/* Adds a position to a given position queue. Specifically, it adds a new 
-   position queue entry pointer to the end of the position queue. The length
-   of the position queue is increased by 1.
+/* Sets up an empty queue whose array is owned by the caller, such as a part
+   of a larger block. The queue must never hold more positions than the 
+   array has room for, since growing it would replace the array, and it must
+   not be passed to posqueue_free.
+
+   @param posqueue* the queue that we are setting up
+   @param pos* the array that holds the positions of the queue
+   @param unsigned int the number of positions the array has room for
+   */
+void posqueue_init(posqueue* q, pos* entries, unsigned int cap);
+
+/* Grows the array of a queue so that it can hold at least a given number of
+   positions without reallocating. Callers that know the most positions the
+   queue will ever hold, such as the number of cells on a board, can size the
+   queue once up front. The function never shrinks the array.
+
+   @param posqueue* the queue that we are growing
+   @param unsigned int the number of positions the queue must be able to hold
+   */
+void posqueue_reserve(posqueue* q, unsigned int cap);
+
+/* Adds a position to a given position queue. Specifically, it adds the 
+   position to the end of the position queue. The length of the position 
+   queue is increased by 1.
 
    @param posqueue* the position queue that we are appending a position to
    @param pos the position that we are appending
@@ -62,16 +95,70 @@ void pos_enqueue(posqueue* q, pos p);
    */
 pos pos_dequeue(posqueue* q);
 
-/* Removes the last position of a given position queue. It alters the tail of
-   the position queue directly, and it returns the position that was removed.
-   The length of the position queue is also decreased by 1.
+/* Removes the last position of a given position queue, and it returns the 
+   position that was removed. The length of the position queue is also 
+   decreased by 1.
 
    @param posqueue* the position queue that we are removing a position from.
    @return pos the postition that was removed
    */
 pos posqueue_remback(posqueue* q);
 
-/* Entirely deallocates an existing queue.
+/* Adds a position to the front of a given position queue, so that it becomes
+   the oldest position. This undoes a pos_dequeue. The length of the position
+   queue is increased by 1.
+
+   @param posqueue* the position queue that we are adding a position to
+   @param pos the position that we are adding
+   */
+void posqueue_addfront(posqueue* q, pos p);
+
+/* Finds a position of a queue by its place in the queue, where 0 is the 
+   oldest position and len - 1 the newest. The returned pointer stays valid
+   until the queue is next enqueued to. Positions should be changed with 
+   posqueue_set instead of through the pointer, so that the key of the queue
+   stays up to date. The function raises an error if the index is out of 
+   range.
+
+   @param posqueue* the queue that we are looking in
+   @param unsigned int the place of the position in the queue
+   @return pos* a pointer to the position at that place
+   */
+pos* posqueue_at(posqueue* q, unsigned int i);
+
+/* Finds the slot of the entries array that holds the position at a given
+   place in a queue. A position keeps its slot while other positions are
+   added and removed around it, as long as the queue never has to grow, so
+   slots can be remembered where places cannot. The function raises an 
+   error if the index is out of range.
+
+   @param posqueue* the queue that we are looking in
+   @param unsigned int the place of the position in the queue
+   @return unsigned int the slot that holds the position
+   */
+unsigned int posqueue_slot(posqueue* q, unsigned int i);
+
+/* Finds the place in a queue of the position held in a given slot of the
+   entries array. This undoes posqueue_slot. The function does not check 
+   that the slot holds a position.
+
+   @param posqueue* the queue that we are looking in
+   @param unsigned int the slot that holds the position
+   @return unsigned int the place of the position in the queue
+   */
+unsigned int posqueue_place(posqueue* q, unsigned int s);
+
+/* Replaces the position at a given place in a queue, updating the key of the
+   queue. The function raises an error if the index is out of range.
+
+   @param posqueue* the queue that we are changing
+   @param unsigned int the place of the position in the queue
+   @param pos the new position
+   */
+void posqueue_set(posqueue* q, unsigned int i, pos p);
+
+/* Entirely deallocates an existing queue created with posqueue_new: both its
+   array and the queue struct itself.
 
    @param posqueue* the queue that is to be deallocated
    */
@@ -0,0 +1,268 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "record.h"
+
+/* The first bytes of every record file. */
+#define RECORD_MAGIC "TTGAMES1"
+
+/* The size of the buffer of a writer. */
+#define RECORD_BUFFER (1 << 16)
+
+
+struct record_writer {
+  int fd;
+  bool in_game;              // whether moves were recorded since the last end
+  size_t len;
+  unsigned char buffer[RECORD_BUFFER];
+};
+
+struct record_reader {
+  const unsigned char* data;
+  size_t size;               // the number of bytes that are mapped
+  size_t at;                 // the offset of the next game
+};
+
+/* Writes a whole block of bytes to a file, however many calls it takes.
+
+   @param int the file descriptor
+   @param void* the bytes
+   @param size_t the number of bytes
+   @return bool false if the file could not be written, otherwise true
+   */
+bool write_all(int fd, const void* bytes, size_t n) {
+  const unsigned char* p = (const unsigned char*) bytes;
+  while (n > 0) {
+    ssize_t done = write(fd, p, n);
+    if (done <= 0) {
+      return false;
+    }
+    p += done;
+    n -= (size_t) done;
+  }
+  return true;
+}
+
+/* Writes out the buffer of a writer and empties it.
+
+   @param record_writer* the writer
+   */
+void flush_buffer(record_writer* w) {
+  if (!write_all(w->fd, w->buffer, w->len)) {
+    fprintf(stderr, "flush_buffer, unable to write record\n");
+    exit(1);
+  }
+  w->len = 0;
+}
+
+/* Appends one byte to the buffer of a writer, writing the buffer out first
+   if it is full.
+
+   @param record_writer* the writer
+   @param unsigned char the byte
+   */
+void put_byte(record_writer* w, unsigned char byte) {
+  if (w->len == RECORD_BUFFER) {
+    flush_buffer(w);
+  }
+  w->buffer[w->len++] = byte;
+}
+
+record_writer* record_writer_open(const char* path, unsigned int run,
+                                  unsigned int width, unsigned int height,
+                                  enum type type) {
+  if (width > RECORD_END || height > 0xFFFF || run > 0xFFFF) {
+    fprintf(stderr, "record_writer_open, board too large to record\n");
+    exit(1);
+  }
+  record_header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, RECORD_MAGIC, sizeof(header.magic));
+  header.height = (uint16_t) height;
+  header.width = (uint16_t) width;
+  header.run = (uint16_t) run;
+  header.type = (uint8_t) type;
+
+  int fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0644);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    fprintf(stderr, "record_writer_open, unable to open %s\n", path);
+    exit(1);
+  }
+
+  record_writer* res = (record_writer*) malloc(sizeof(record_writer));
+  if (!res) {
+    fprintf(stderr, "record_writer_open, unable to allocate result\n");
+    exit(1);
+  }
+  res->fd = fd;
+  res->in_game = false;
+  res->len = 0;
+
+  if (st.st_size == 0) {
+    if (!write_all(fd, &header, sizeof(header))) {
+      fprintf(stderr, "record_writer_open, unable to write %s\n", path);
+      exit(1);
+    }
+    return res;
+  }
+  record_header found;
+  if (pread(fd, &found, sizeof(found), 0) != sizeof(found) ||
+      memcmp(&found, &header, sizeof(header)) != 0) {
+    fprintf(stderr, "record_writer_open, %s holds games of another board\n",
+            path);
+    exit(1);
+  }
+  // a writer that never closed may have left a game without its end
+  unsigned char last;
+  if ((size_t) st.st_size > sizeof(header) &&
+      pread(fd, &last, 1, st.st_size - 1) == 1 && last != RECORD_END) {
+    put_byte(res, RECORD_END);
+  }
+  return res;
+}
+
+void record_move(record_writer* w, move m) {
+  switch (m.type) {
+    case MOVE_DROP:
+      put_byte(w, (unsigned char) m.column);
+      break;
+    case MOVE_DISARRAY:
+      put_byte(w, RECORD_DISARRAY);
+      break;
+    case MOVE_OFFSET:
+      put_byte(w, RECORD_OFFSET);
+      break;
+  }
+  w->in_game = true;
+}
+
+void record_end_game(record_writer* w) {
+  put_byte(w, RECORD_END);
+  w->in_game = false;
+}
+
+void record_game(record_writer* w, const move* moves, unsigned int n) {
+  for (unsigned int i = 0; i < n; i++) {
+    record_move(w, moves[i]);
+  }
+  record_end_game(w);
+}
+
+void record_writer_close(record_writer* w) {
+  if (w->in_game) {
+    record_end_game(w);
+  }
+  flush_buffer(w);
+  if (close(w->fd) != 0) {
+    fprintf(stderr, "record_writer_close, unable to close record\n");
+    exit(1);
+  }
+  free(w);
+}
+
+/* Checks that the header of a record file describes a board that a game can
+   be created for, so a damaged header is reported as such rather than by
+   new_game.
+
+   @param record_header* the header that we are checking
+   @return bool true if the header is valid, otherwise false
+   */
+bool header_valid(const record_header* h) {
+  return memcmp(h->magic, RECORD_MAGIC, sizeof(h->magic)) == 0 &&
+         h->type <= COLUMNS && h->reserved == 0 && h->width >= 1 &&
+         h->width <= RECORD_END && h->height >= 1 && h->run >= 1 &&
+         (h->run <= h->width || h->run <= h->height);
+}
+
+record_reader* record_reader_open(const char* path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "record_reader_open, unable to open %s\n", path);
+    exit(1);
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(record_header)) {
+    fprintf(stderr, "record_reader_open, %s is not a record file\n", path);
+    exit(1);
+  }
+  size_t size = (size_t) st.st_size;
+  void* map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "record_reader_open, unable to map %s\n", path);
+    exit(1);
+  }
+  if (!header_valid((const record_header*) map)) {
+    fprintf(stderr, "record_reader_open, %s is not a record file\n", path);
+    exit(1);
+  }
+  // games are read front to back, so the kernel can read ahead
+  madvise(map, size, MADV_SEQUENTIAL);
+
+  record_reader* res = (record_reader*) malloc(sizeof(record_reader));
+  if (!res) {
+    fprintf(stderr, "record_reader_open, unable to allocate result\n");
+    exit(1);
+  }
+  res->data = (const unsigned char*) map;
+  res->size = size;
+  res->at = sizeof(record_header);
+  return res;
+}
+
+void record_reader_close(record_reader* r) {
+  munmap((void*) r->data, r->size);
+  free(r);
+}
+
+const record_header* record_info(record_reader* r) {
+  return (const record_header*) r->data;
+}
+
+bool record_replay(record_reader* r, game* g, unsigned int* moves) {
+  const record_header* h = record_info(r);
+  if (g->b->width != h->width || g->b->height != h->height ||
+      g->run != h->run) {
+    fprintf(stderr, "record_replay, game does not match the record\n");
+    exit(1);
+  }
+  if (r->at >= r->size) {
+    return false;
+  }
+
+  game_reset(g);
+  unsigned int n = 0;
+  // a file cut short ends its last game early
+  while (r->at < r->size) {
+    unsigned char byte = r->data[r->at++];
+    bool legal = true;
+    if (byte == RECORD_END) {
+      break;
+    } else if (byte == RECORD_DISARRAY) {
+      disarray(g);
+    } else if (byte == RECORD_OFFSET) {
+      legal = offset(g);
+    } else {
+      legal = drop_piece(g, byte);
+    }
+    if (!legal) {
+      fprintf(stderr, "record_replay, illegal move at byte %zu\n",
+              r->at - 1);
+      exit(1);
+    }
+    n++;
+  }
+  if (moves) {
+    *moves = n;
+  }
+  return true;
+}
+
+void record_rewind(record_reader* r) {
+  r->at = sizeof(record_header);
+}
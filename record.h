@@ -0,0 +1,129 @@
+#ifndef RECORD_H
+#define RECORD_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "logic.h"
+
+/* The byte of a move that ends a game. Drops are stored as their column,
+   so a record holds boards of at most RECORD_END columns. */
+#define RECORD_END 0xFD
+
+/* The byte of a disarray. */
+#define RECORD_DISARRAY 0xFE
+
+/* The byte of an offset. */
+#define RECORD_OFFSET 0xFF
+
+
+/* The start of a record file. It is followed by the games, one after the
+   other, each one byte per move and ended by RECORD_END. */
+struct record_header {
+    char magic[8];
+    uint16_t height, width, run;
+    uint8_t type;
+    uint8_t reserved;
+};
+
+typedef struct record_header record_header;
+
+
+struct record_writer;
+
+typedef struct record_writer record_writer;
+
+
+struct record_reader;
+
+typedef struct record_reader record_reader;
+
+/* Opens a record file to append games to, creating it with a header if it
+   is empty or does not exist. Moves are gathered in a buffer of the writer
+   and only written out when it fills, so a move costs one byte of memory
+   traffic. The function raises an error if the file cannot be opened, if
+   it holds games of another board, or if the board is too wide to record.
+
+   @param char* the path of the file
+   @param unsigned int the number of cells in a row to make a run
+   @param unsigned int the number of columns of the board
+   @param unsigned int the number of rows of the board
+   @param enum type the representation of the board
+   @return record_writer* a pointer to the opened writer
+   */
+record_writer* record_writer_open(const char* path, unsigned int run,
+                                  unsigned int width, unsigned int height,
+                                  enum type type);
+
+/* Appends a move to the game being recorded.
+
+   @param record_writer* the writer
+   @param move the move that was played
+   */
+void record_move(record_writer* w, move m);
+
+/* Ends the game being recorded, so that the next move starts a new game.
+
+   @param record_writer* the writer
+   */
+void record_end_game(record_writer* w);
+
+/* Appends a whole game at once.
+
+   @param record_writer* the writer
+   @param move* the moves of the game
+   @param unsigned int the number of moves
+   */
+void record_game(record_writer* w, const move* moves, unsigned int n);
+
+/* Writes out the buffer of a writer, closes its file, and deallocates it.
+   A game that was not ended is ended first.
+
+   @param record_writer* the writer that we are closing
+   */
+void record_writer_close(record_writer* w);
+
+/* Opens a record file for reading by mapping it into memory, so that games
+   are read in place. The function raises an error if the file cannot be
+   mapped, or if it is not a record file: its header must start with the
+   magic bytes and describe a board of a known type, with a run length that
+   fits, as record_writer_open writes it.
+
+   @param char* the path of the file
+   @return record_reader* a pointer to the opened reader
+   */
+record_reader* record_reader_open(const char* path);
+
+/* Unmaps a record file and deallocates the reader.
+
+   @param record_reader* the reader that we are closing
+   */
+void record_reader_close(record_reader* r);
+
+/* Reads the board a record file holds games of.
+
+   @param record_reader* the reader
+   @return record_header* the header of the file
+   */
+const record_header* record_info(record_reader* r);
+
+/* Replays the next game of a record file into a game, which is reset
+   first, so one game of the size of the record can replay every game in
+   the file without allocating. The moves are played with drop_piece,
+   disarray, and offset, which keep no undo records. The function raises an
+   error if the game has another board size or a move is illegal.
+
+   @param record_reader* the reader
+   @param game* the game that the moves are played in
+   @param unsigned int* where the number of moves of the game is stored, or
+   NULL if it is not needed
+   @return bool false if every game has been read, otherwise true
+   */
+bool record_replay(record_reader* r, game* g, unsigned int* moves);
+
+/* Starts reading a record file from its first game again.
+
+   @param record_reader* the reader
+   */
+void record_rewind(record_reader* r);
+
+#endif /* RECORD_H */
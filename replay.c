@@ -0,0 +1,63 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "logic.h"
+#include "board.h"
+#include "record.h"
+#include "timer.h"
+
+/* Replays every game of a record file written by play or selfplay with -R,
+   on one game that is reset between games, and prints games/sec,
+   moves/sec, and how the games ended. Takes the path of the file, and the
+   number of times to replay the whole file with -n (once by default).
+   */
+int main(int argc, char* argv[]) {
+  char* path = NULL;
+  int passes = 1;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+      passes = atoi(argv[++i]);
+    } else if (argv[i][0] != '-' && !path) {
+      path = argv[i];
+    } else {
+      fprintf(stderr, "usage: %s FILE [-n PASSES]\n", argv[0]);
+      exit(1);
+    }
+  }
+  if (!path || passes < 1) {
+    fprintf(stderr, "replay, a record file and a positive number of passes "
+            "are required\n");
+    exit(1);
+  }
+
+  record_reader* r = record_reader_open(path);
+  const record_header* h = record_info(r);
+  game* g = new_game(h->run, h->width, h->height, (enum type) h->type);
+
+  unsigned long long games = 0, moves = 0, outcomes[4] = {0, 0, 0, 0};
+  double start = now();
+  for (int pass = 0; pass < passes; pass++) {
+    record_rewind(r);
+    unsigned int n;
+    while (record_replay(r, g, &n)) {
+      games++;
+      moves += n;
+      outcomes[game_outcome(g)]++;
+    }
+  }
+  double seconds = now() - start;
+
+  printf("%llu games, %llu moves in %.3f s: %.0f games/sec, "
+         "%.0f moves/sec\n", games, moves, seconds,
+         seconds > 0 ? games / seconds : 0.0,
+         seconds > 0 ? moves / seconds : 0.0);
+  static const char* names[] = {"unfinished", "black wins", "white wins",
+                                "draws"};
+  for (unsigned int k = 0; k < 4; k++) {
+    printf("%-12s %10llu\n", names[k], outcomes[k]);
+  }
+
+  game_free(g);
+  record_reader_close(r);
+  return 0;
+}
@@ -0,0 +1,336 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "logic.h"
+#include "board.h"
+#include "pool.h"
+#include "record.h"
+#include "step.h"
+#include "timer.h"
+
+/* The number of bars in the game length histogram. */
+#define HISTOGRAM_BARS 10
+
+/* The widest bar of the histogram, in characters. */
+#define HISTOGRAM_WIDTH 50
+
+/* How a player picks its moves. A random player picks uniformly among the
+   legal moves; a weighted player picks a kind of move (drop, offset, or
+   disarray) with the given weights, then a drop column uniformly. */
+enum policy {
+    POLICY_RANDOM,
+    POLICY_WEIGHTED
+};
+
+typedef enum policy policy;
+
+
+/* Everything a batch of games shares, along with the totals that every
+   chunk of games adds to when it is done. The totals are guarded by the
+   lock. */
+struct selfplay {
+    unsigned int run, width, height;
+    enum type type;
+    policy policies[2];
+    unsigned int weights[3];
+    unsigned int max_moves;
+    uint64_t seed;
+    record_writer* record;     // where finished games are appended, if set
+
+    pthread_mutex_t lock;
+    unsigned long long moves;
+    unsigned long long outcomes[5];
+    unsigned long long* lengths;
+};
+
+typedef struct selfplay selfplay;
+
+/* Advances a splitmix64 generator and returns its next value. Each game
+   seeds its own generator from the seed of the batch and its number, so the
+   games played do not depend on how they are split between threads.
+
+   @param uint64_t* the state of the generator
+   @return uint64_t the next pseudo-random value
+   */
+uint64_t next_random(uint64_t* state) {
+  uint64_t x = (*state += 0x9E3779B97F4A7C15ULL);
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  return x ^ (x >> 31);
+}
+
+/* Picks a move for the player whose turn it is.
+
+   @param selfplay* the batch the game belongs to
+   @param game* the game that we are picking a move in
+   @param move* room for the legal moves of the game
+   @param uint64_t* the generator of the game
+   @return move the move that was picked
+   */
+move pick_move(selfplay* s, game* g, move* moves, uint64_t* rng) {
+  unsigned int n = legal_moves(g, moves);
+  if (s->policies[g->player] == POLICY_RANDOM) {
+    return moves[next_random(rng) % n];
+  }
+
+  // legal_moves lists the drops first, then the offset, then the disarray
+  bool can_offset = n >= 2 && moves[n - 2].type == MOVE_OFFSET;
+  unsigned int drops = n - 1 - can_offset;
+  unsigned int kinds[3] = {drops ? s->weights[0] : 0,
+                           can_offset ? s->weights[1] : 0, s->weights[2]};
+  unsigned int total = kinds[0] + kinds[1] + kinds[2];
+  if (total == 0) {
+    return moves[n - 1];
+  }
+  unsigned int pick = next_random(rng) % total;
+  if (pick < kinds[0]) {
+    return moves[next_random(rng) % drops];
+  }
+  if (pick < kinds[0] + kinds[1]) {
+    return moves[n - 2];
+  }
+  return moves[n - 1];
+}
+
+/* Pool task that plays a chunk of the games of a batch on one game that is
+   reset between games, then adds its totals to those of the batch. Moves
+   are played with apply_move, which keeps no undo records. If the batch is
+   recorded, each game is appended to the record once it is over, so games
+   from different threads are recorded in the order they end.
+
+   @param void* the batch that we are playing
+   @param unsigned int the number of the first game of the chunk
+   @param unsigned int one past the number of the last game of the chunk
+   */
+void play_games(void* a, unsigned int lo, unsigned int hi) {
+  selfplay* s = (selfplay*) a;
+  game* g = new_game(s->run, s->width, s->height, s->type);
+  move* moves = (move*) malloc((s->width + 2) * sizeof(move));
+  unsigned long long* lengths = (unsigned long long*)
+                                  calloc(s->max_moves + 1,
+                                         sizeof(unsigned long long));
+  move* history = NULL;
+  if (s->record) {
+    history = (move*) malloc((s->max_moves + 1) * sizeof(move));
+  }
+  if (!moves || !lengths || (s->record && !history)) {
+    fprintf(stderr, "play_games, unable to allocate chunk\n");
+    exit(1);
+  }
+
+  unsigned long long total_moves = 0, outcomes[5] = {0, 0, 0, 0, 0};
+  for (unsigned int i = lo; i < hi; i++) {
+    uint64_t rng = s->seed ^ ((uint64_t) i * 0xD1B54A32D192ED03ULL);
+    game_reset(g);
+    unsigned int played = 0;
+    outcome o = game_outcome(g);
+    while (o == IN_PROGRESS && played < s->max_moves) {
+      move m = pick_move(s, g, moves, &rng);
+      apply_move(g, m);
+      if (history) {
+        history[played] = m;
+      }
+      played++;
+      o = game_outcome(g);
+    }
+    if (history) {
+      pthread_mutex_lock(&s->lock);
+      record_game(s->record, history, played);
+      pthread_mutex_unlock(&s->lock);
+    }
+    // games stopped by the move limit are counted after the four outcomes
+    outcomes[o == IN_PROGRESS ? 4 : o]++;
+    lengths[played]++;
+    total_moves += played;
+  }
+
+  pthread_mutex_lock(&s->lock);
+  s->moves += total_moves;
+  for (unsigned int k = 0; k < 5; k++) {
+    s->outcomes[k] += outcomes[k];
+  }
+  for (unsigned int k = 0; k <= s->max_moves; k++) {
+    s->lengths[k] += lengths[k];
+  }
+  pthread_mutex_unlock(&s->lock);
+
+  free(history);
+  free(lengths);
+  free(moves);
+  game_free(g);
+}
+
+/* Reads the name of a policy.
+
+   @param char* the name, either random or weighted
+   @return policy the policy with that name
+   */
+policy parse_policy(char* name) {
+  if (strcmp(name, "random") == 0) {
+    return POLICY_RANDOM;
+  }
+  if (strcmp(name, "weighted") == 0) {
+    return POLICY_WEIGHTED;
+  }
+  fprintf(stderr, "parse_policy, unknown policy %s\n", name);
+  exit(1);
+}
+
+/* Prints a histogram of the lengths of the games of a batch, with the
+   lengths split into equal ranges up to the longest game.
+
+   @param selfplay* the batch that was played
+   */
+void show_lengths(selfplay* s) {
+  unsigned int longest = 0;
+  for (unsigned int k = 0; k <= s->max_moves; k++) {
+    if (s->lengths[k]) {
+      longest = k;
+    }
+  }
+  unsigned int span = longest / HISTOGRAM_BARS + 1;
+  unsigned long long bars[HISTOGRAM_BARS] = {0}, tallest = 0;
+  for (unsigned int k = 0; k <= longest; k++) {
+    bars[k / span] += s->lengths[k];
+  }
+  for (unsigned int i = 0; i < HISTOGRAM_BARS; i++) {
+    tallest = bars[i] > tallest ? bars[i] : tallest;
+  }
+
+  printf("game lengths:\n");
+  for (unsigned int i = 0; i < HISTOGRAM_BARS && i * span <= longest; i++) {
+    unsigned int width = tallest ? bars[i] * HISTOGRAM_WIDTH / tallest : 0;
+    printf("  %6u-%-6u %10llu ", i * span, (i + 1) * span - 1, bars[i]);
+    for (unsigned int j = 0; j < width; j++) {
+      putchar('#');
+    }
+    putchar('\n');
+  }
+}
+
+/* Plays a batch of complete games between two policies without any output
+   but the totals. Takes the height, width, and run length with -h, -w, and
+   -r as play does, and the number of games with -n. The policies are set
+   with -B and -W (random or weighted, random by default), and the weights
+   of a weighted player with -k DROP,OFFSET,DISARRAY (8,1,1 by default). A
+   game ends when game_outcome finds it over, or after -l moves (50 times
+   the number of cells by default), when it counts as unfinished. The board
+   representation is chosen with -m, -b, -p, or -c, the seed with -s, and
+   the number of threads with -j (every processor by default). Games are
+   split between the threads in chunks, and each thread reuses one game.
+   With -R FILE every game is appended to a record file (see record.h).
+   */
+int main(int argc, char* argv[]) {
+  selfplay s;
+  int h = 0, w = 0, r = 0, threads = 0;
+  long long limit = -1, games = 1000;
+  s.type = MATRIX;
+  s.policies[BLACKS_TURN] = s.policies[WHITES_TURN] = POLICY_RANDOM;
+  s.weights[0] = 8;
+  s.weights[1] = 1;
+  s.weights[2] = 1;
+  s.seed = 1;
+  char* record = NULL;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-h") == 0 && i + 1 < argc) {
+      h = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+      w = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+      r = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+      games = atoll(argv[++i]);
+    } else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+      limit = atoll(argv[++i]);
+    } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+      s.seed = strtoull(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+      threads = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-R") == 0 && i + 1 < argc) {
+      record = argv[++i];
+    } else if (strcmp(argv[i], "-B") == 0 && i + 1 < argc) {
+      s.policies[BLACKS_TURN] = parse_policy(argv[++i]);
+    } else if (strcmp(argv[i], "-W") == 0 && i + 1 < argc) {
+      s.policies[WHITES_TURN] = parse_policy(argv[++i]);
+    } else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc) {
+      if (sscanf(argv[++i], "%u,%u,%u", &s.weights[0], &s.weights[1],
+                 &s.weights[2]) != 3) {
+        fprintf(stderr, "selfplay, weights are given as DROP,OFFSET,"
+                "DISARRAY\n");
+        exit(1);
+      }
+    } else if (strcmp(argv[i], "-m") == 0) {
+      s.type = MATRIX;
+    } else if (strcmp(argv[i], "-b") == 0) {
+      s.type = BITS;
+    } else if (strcmp(argv[i], "-p") == 0) {
+      s.type = BITBOARD;
+    } else if (strcmp(argv[i], "-c") == 0) {
+      s.type = COLUMNS;
+    } else {
+      fprintf(stderr, "usage: %s -h HEIGHT -w WIDTH -r RUN [-n GAMES] "
+              "[-l MOVES] [-B POLICY] [-W POLICY] [-k D,O,A] [-s SEED] "
+              "[-j THREADS] [-R FILE] [-m] [-b] [-p] [-c]\n", argv[0]);
+      exit(1);
+    }
+  }
+
+  if (h < 1 || w < 1 || r < 1 || games < 1 || games > 0xFFFFFFFFLL) {
+    fprintf(stderr, "selfplay, a height, width, run length, and a positive "
+            "number of games are required\n");
+    exit(1);
+  }
+  if (limit < 0) {
+    limit = 50LL * h * w;
+  }
+  if (limit > 100000000LL) {
+    fprintf(stderr, "selfplay, move limit too large\n");
+    exit(1);
+  }
+  s.run = r;
+  s.width = w;
+  s.height = h;
+  s.max_moves = (unsigned int) limit;
+  s.moves = 0;
+  memset(s.outcomes, 0, sizeof(s.outcomes));
+  s.lengths = (unsigned long long*) calloc(s.max_moves + 1,
+                                           sizeof(unsigned long long));
+  if (!s.lengths) {
+    fprintf(stderr, "selfplay, unable to allocate histogram\n");
+    exit(1);
+  }
+  pthread_mutex_init(&s.lock, NULL);
+  // checks the configuration before any thread starts
+  game_free(new_game(r, w, h, s.type));
+  s.record = record ? record_writer_open(record, r, w, h, s.type) : NULL;
+
+  pool* p = threads > 0 ? pool_new(threads - 1) : pool_shared();
+  double start = now();
+  pool_run(p, (unsigned int) games, play_games, &s);
+  double seconds = now() - start;
+  if (threads > 0) {
+    pool_free(p);
+  }
+
+  printf("%lld games, %llu moves in %.3f s: %.0f games/sec, "
+         "%.0f moves/sec\n", games, s.moves, seconds,
+         seconds > 0 ? games / seconds : 0.0,
+         seconds > 0 ? s.moves / seconds : 0.0);
+  static const char* names[] = {"in progress", "black wins", "white wins",
+                                "draws", "unfinished"};
+  for (unsigned int k = BLACK_WIN; k <= 4; k++) {
+    printf("%-12s %10llu (%5.1f%%)\n", names[k], s.outcomes[k],
+           100.0 * s.outcomes[k] / games);
+  }
+  show_lengths(&s);
+
+  if (s.record) {
+    record_writer_close(s.record);
+  }
+  pthread_mutex_destroy(&s.lock);
+  free(s.lengths);
+  return 0;
+}
@@ -0,0 +1,530 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "logic.h"
+#include "board.h"
+#include "step.h"
+
+/* The longest command a client may send, newline included. */
+#define SERVER_LINE 256
+
+/* The most events handled per call to epoll_wait. */
+#define SERVER_EVENTS 256
+
+/* The most bytes of replies a client may leave unread before the server
+   stops reading its commands. */
+#define SERVER_BACKLOG (1 << 20)
+
+/* The largest width or height of a game, the same limit play puts on the
+   width so that every column has a label. */
+#define SERVER_MAX_SIDE 62
+
+
+/* One client and the game it owns. Commands are gathered in the input
+   buffer until a whole line has arrived, and replies wait in the output
+   buffer until the socket takes them. */
+struct conn {
+    int fd;
+    game* g;
+    char in[SERVER_LINE];
+    size_t in_len;
+    char* out;
+    size_t out_len, out_sent, out_cap;
+    uint32_t events;         // the events epoll reports for the socket
+    bool closing;            // whether to close once the replies are sent
+    struct conn *prev, *next;
+};
+
+typedef struct conn conn;
+
+
+struct server {
+    int epoll, listener;
+    conn* conns;
+    unsigned int len;
+};
+
+typedef struct server server;
+
+/* Set by the signal handler to stop the event loop. */
+volatile sig_atomic_t stopping = 0;
+
+/* Stops the event loop on SIGINT or SIGTERM.
+
+   @param int the signal
+   */
+void stop(int sig) {
+  (void) sig;
+  stopping = 1;
+}
+
+/* Makes a file descriptor non-blocking.
+
+   @param int the file descriptor
+   */
+void set_nonblocking(int fd) {
+  int flags = fcntl(fd, F_GETFL, 0);
+  if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+    fprintf(stderr, "set_nonblocking, unable to set flags\n");
+    exit(1);
+  }
+}
+
+/* Makes room in the output buffer of a connection.
+
+   @param conn* the connection
+   @param size_t the number of bytes about to be added
+   */
+void reserve_out(conn* c, size_t n) {
+  if (c->out_len + n <= c->out_cap) {
+    return;
+  }
+  size_t cap = c->out_cap ? c->out_cap : 1024;
+  while (cap < c->out_len + n) {
+    cap *= 2;
+  }
+  char* out = (char*) realloc(c->out, cap);
+  if (!out) {
+    fprintf(stderr, "reserve_out, unable to allocate output\n");
+    exit(1);
+  }
+  c->out = out;
+  c->out_cap = cap;
+}
+
+/* Adds formatted text to the output buffer of a connection.
+
+   @param conn* the connection
+   @param char* the format, as for printf
+   */
+void send_text(conn* c, const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  int n = vsnprintf(NULL, 0, format, args);
+  va_end(args);
+  reserve_out(c, (size_t) n + 1);
+  va_start(args, format);
+  vsnprintf(c->out + c->out_len, (size_t) n + 1, format, args);
+  va_end(args);
+  c->out_len += (size_t) n;
+}
+
+/* Adds the state of the game of a connection to its output buffer: a line
+   with whose turn it is and the outcome of the game, then one line of
+   cells for each row of the board, top row first, with . for an empty
+   cell, * for black, and o for white.
+
+   @param conn* the connection
+   */
+void send_state(conn* c) {
+  static const char* outcomes[] = {"in_progress", "black_wins",
+                                   "white_wins", "draw"};
+  game* g = c->g;
+  send_text(c, "STATE %s %s\n",
+            g->player == BLACKS_TURN ? "black" : "white",
+            outcomes[game_outcome(g)]);
+  unsigned int w = g->b->width, h = g->b->height;
+  reserve_out(c, (size_t) (w + 1) * h);
+  for (unsigned int r = 0; r < h; r++) {
+    for (unsigned int col = 0; col < w; col++) {
+      cell x = board_get_unchecked(g->b, make_pos(r, col));
+      c->out[c->out_len++] = x == EMPTY ? '.' : x == BLACK ? '*' : 'o';
+    }
+    c->out[c->out_len++] = '\n';
+  }
+}
+
+/* Runs one command of a client and adds the reply to its output buffer.
+   The commands are NEW HEIGHT WIDTH RUN TYPE, where the type is m, b, p,
+   or c as for play, which starts a new game; MOVE M, where M is a move as
+   it is entered in play (a column label, ^, or !); STATE; and QUIT. NEW,
+   MOVE, and STATE reply with the state of the game (see send_state), and
+   anything that fails replies with a line starting with ERR.
+
+   @param conn* the connection
+   @param char* the command, without its newline
+   */
+void run_command(conn* c, char* line) {
+  char word[16];
+  int n = 0;
+  if (sscanf(line, "%15s%n", word, &n) != 1) {
+    send_text(c, "ERR empty command\n");
+    return;
+  }
+  char* rest = line + n;
+
+  if (strcmp(word, "NEW") == 0) {
+    unsigned int h, w, r;
+    char type;
+    if (sscanf(rest, "%u %u %u %c", &h, &w, &r, &type) != 4) {
+      send_text(c, "ERR usage: NEW HEIGHT WIDTH RUN m|b|p|c\n");
+      return;
+    }
+    enum type t;
+    switch (type) {
+      case 'm': t = MATRIX; break;
+      case 'b': t = BITS; break;
+      case 'p': t = BITBOARD; break;
+      case 'c': t = COLUMNS; break;
+      default:
+        send_text(c, "ERR unknown board type %c\n", type);
+        return;
+    }
+    if (h < 1 || w < 1 || r < 1 || h > SERVER_MAX_SIDE ||
+        w > SERVER_MAX_SIDE || (r > h && r > w)) {
+      send_text(c, "ERR unplayable board\n");
+      return;
+    }
+    if (c->g) {
+      game_free(c->g);
+    }
+    c->g = new_game(r, w, h, t);
+    send_state(c);
+  } else if (strcmp(word, "MOVE") == 0) {
+    char input;
+    move m;
+    if (!c->g) {
+      send_text(c, "ERR no game, start one with NEW\n");
+    } else if (sscanf(rest, " %c", &input) != 1) {
+      send_text(c, "ERR usage: MOVE COLUMN|^|!\n");
+    } else {
+      switch (game_step(c->g, input, &m)) {
+        case STEP_PLAYED:
+          send_state(c);
+          break;
+        case STEP_INVALID:
+          send_text(c, "ERR %c is not a move\n", input);
+          break;
+        case STEP_ILLEGAL:
+          send_text(c, "ERR %c is not legal\n", input);
+          break;
+        case STEP_OVER:
+          send_text(c, "ERR the game is over\n");
+          break;
+      }
+    }
+  } else if (strcmp(word, "STATE") == 0) {
+    if (c->g) {
+      send_state(c);
+    } else {
+      send_text(c, "ERR no game, start one with NEW\n");
+    }
+  } else if (strcmp(word, "QUIT") == 0) {
+    send_text(c, "BYE\n");
+    c->closing = true;
+  } else {
+    send_text(c, "ERR unknown command %s\n", word);
+  }
+}
+
+/* Closes a connection and frees its game.
+
+   @param server* the server
+   @param conn* the connection that we are closing
+   */
+void close_conn(server* s, conn* c) {
+  epoll_ctl(s->epoll, EPOLL_CTL_DEL, c->fd, NULL);
+  close(c->fd);
+  if (c->prev) {
+    c->prev->next = c->next;
+  } else {
+    s->conns = c->next;
+  }
+  if (c->next) {
+    c->next->prev = c->prev;
+  }
+  s->len--;
+  if (c->g) {
+    game_free(c->g);
+  }
+  free(c->out);
+  free(c);
+}
+
+/* Sends as much of the output buffer of a connection as the socket takes.
+   Epoll reports room to write only while some replies are left, and
+   reports new commands only while the replies left are fewer than
+   SERVER_BACKLOG bytes, so a client that does not read cannot make the
+   server hold its replies without bound.
+
+   @param server* the server
+   @param conn* the connection
+   @return bool false if the connection was closed, otherwise true
+   */
+bool flush_conn(server* s, conn* c) {
+  while (c->out_sent < c->out_len) {
+    ssize_t n = send(c->fd, c->out + c->out_sent, c->out_len - c->out_sent,
+                     MSG_NOSIGNAL);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      break;
+    }
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      close_conn(s, c);
+      return false;
+    }
+    c->out_sent += (size_t) n;
+  }
+  if (c->out_sent == c->out_len) {
+    c->out_sent = c->out_len = 0;
+    if (c->closing) {
+      close_conn(s, c);
+      return false;
+    }
+  }
+  uint32_t events = (c->out_sent < c->out_len ? EPOLLOUT : 0) |
+                    (c->out_len - c->out_sent < SERVER_BACKLOG &&
+                     !c->closing ? EPOLLIN : 0);
+  if (events != c->events) {
+    struct epoll_event ev;
+    ev.events = events;
+    ev.data.ptr = c;
+    epoll_ctl(s->epoll, EPOLL_CTL_MOD, c->fd, &ev);
+    c->events = events;
+  }
+  return true;
+}
+
+/* Runs every whole command in the input buffer of a connection, as long
+   as the replies left to send stay under SERVER_BACKLOG bytes. The rest
+   stays in the buffer.
+
+   @param conn* the connection
+   */
+void run_lines(conn* c) {
+  size_t start = 0;
+  for (size_t i = 0; i < c->in_len && !c->closing &&
+                     c->out_len - c->out_sent < SERVER_BACKLOG; i++) {
+    if (c->in[i] == '\n') {
+      c->in[i] = '\0';
+      if (i > start && c->in[i - 1] == '\r') {
+        c->in[i - 1] = '\0';
+      }
+      run_command(c, c->in + start);
+      start = i + 1;
+    }
+  }
+  memmove(c->in, c->in + start, c->in_len - start);
+  c->in_len -= start;
+  if (c->in_len == SERVER_LINE) {
+    send_text(c, "ERR command too long\n");
+    c->closing = true;
+  }
+}
+
+/* Serves a connection that epoll reported: sends the replies left over,
+   runs the commands left in the buffer, then reads and runs new commands
+   until the socket has no more or the replies pile up, and sends the
+   replies.
+
+   @param server* the server
+   @param conn* the connection
+   */
+void serve_conn(server* s, conn* c) {
+  if (!flush_conn(s, c)) {
+    return;
+  }
+  run_lines(c);
+  while (!c->closing && c->out_len - c->out_sent < SERVER_BACKLOG) {
+    ssize_t n = recv(c->fd, c->in + c->in_len, SERVER_LINE - c->in_len, 0);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      break;
+    }
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      close_conn(s, c);
+      return;
+    }
+    c->in_len += (size_t) n;
+    run_lines(c);
+  }
+  flush_conn(s, c);
+}
+
+/* Accepts every connection that is waiting on the listening socket.
+
+   @param server* the server
+   */
+void accept_conns(server* s) {
+  while (true) {
+    int fd = accept(s->listener, NULL, NULL);
+    if (fd < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        perror("accept_conns");
+      }
+      if (errno != EINTR) {
+        return;
+      }
+      continue;
+    }
+    set_nonblocking(fd);
+    conn* c = (conn*) calloc(1, sizeof(conn));
+    if (!c) {
+      fprintf(stderr, "accept_conns, unable to allocate connection\n");
+      exit(1);
+    }
+    c->fd = fd;
+    c->events = EPOLLIN;
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = c;
+    if (epoll_ctl(s->epoll, EPOLL_CTL_ADD, fd, &ev) < 0) {
+      perror("accept_conns");
+      close(fd);
+      free(c);
+      continue;
+    }
+    c->next = s->conns;
+    if (s->conns) {
+      s->conns->prev = c;
+    }
+    s->conns = c;
+    s->len++;
+  }
+}
+
+/* Opens the listening socket, on a TCP port of localhost or on a Unix
+   socket.
+
+   @param int the port, used if there is no path
+   @param char* the path of the Unix socket, or NULL for TCP
+   @return int the listening socket
+   */
+int listen_on(int port, const char* path) {
+  int fd;
+  if (path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+      fprintf(stderr, "listen_on, socket path too long\n");
+      exit(1);
+    }
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || bind(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0) {
+      perror("listen_on");
+      exit(1);
+    }
+  } else {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t) port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    if (fd < 0 ||
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0 ||
+        bind(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0) {
+      perror("listen_on");
+      exit(1);
+    }
+  }
+  if (listen(fd, SOMAXCONN) < 0) {
+    perror("listen_on");
+    exit(1);
+  }
+  set_nonblocking(fd);
+  return fd;
+}
+
+/* Serves games to many clients at once from one thread, with a single
+   epoll event loop over non-blocking sockets. Each connection owns one
+   game, played with the same step function as play, and every command is
+   one line (see run_command). Listens on a TCP port of localhost with -p
+   PORT (7777 by default), or on a Unix socket with -u PATH, and runs until
+   it is interrupted.
+   */
+int main(int argc, char* argv[]) {
+  int port = 7777;
+  char* path = NULL;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+      port = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-u") == 0 && i + 1 < argc) {
+      path = argv[++i];
+    } else {
+      fprintf(stderr, "usage: %s [-p PORT] [-u PATH]\n", argv[0]);
+      exit(1);
+    }
+  }
+  if (!path && (port < 1 || port > 65535)) {
+    fprintf(stderr, "server, port out of range\n");
+    exit(1);
+  }
+
+  server s;
+  s.conns = NULL;
+  s.len = 0;
+  s.listener = listen_on(port, path);
+  s.epoll = epoll_create1(0);
+  if (s.epoll < 0) {
+    perror("server");
+    exit(1);
+  }
+  struct epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.ptr = NULL;
+  epoll_ctl(s.epoll, EPOLL_CTL_ADD, s.listener, &ev);
+
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = stop;
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+  if (path) {
+    printf("listening on %s\n", path);
+  } else {
+    printf("listening on 127.0.0.1:%d\n", port);
+  }
+  fflush(stdout);
+
+  struct epoll_event events[SERVER_EVENTS];
+  while (!stopping) {
+    int n = epoll_wait(s.epoll, events, SERVER_EVENTS, -1);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      perror("server");
+      exit(1);
+    }
+    for (int i = 0; i < n; i++) {
+      conn* c = (conn*) events[i].data.ptr;
+      if (c) {
+        serve_conn(&s, c);
+      } else {
+        accept_conns(&s);
+      }
+    }
+  }
+
+  printf("closing %u connections\n", s.len);
+  while (s.conns) {
+    close_conn(&s, s.conns);
+  }
+  close(s.listener);
+  close(s.epoll);
+  if (path) {
+    unlink(path);
+  }
+  return 0;
+}
@@ -0,0 +1,504 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "logic.h"
+#include "board.h"
+#include "pool.h"
+#include "solvedb.h"
+#include "timer.h"
+
+/* The most positions expanded by one job of the pool. The successors of a
+   batch are held until they are merged, so this bounds that memory. */
+#define SOLVE_BATCH 65536
+
+/* Marks an empty slot of the table of positions. */
+#define SOLVE_EMPTY 0xFFFFFFFFu
+
+
+/* Every reachable position of one board size and run length, along with
+   the moves between them. A position is stored as one byte for whose turn
+   it is and one byte for each cell: 0 for an empty cell, otherwise 1 plus
+   twice the place of the piece in the queue of its owner, plus 1 for white.
+   Unlike the board alone, this keeps the order of the queues, which decides
+   what an offset removes. Positions are numbered in the order they are
+   found, and the moves out of position i are edges[first[i]] up to
+   edges[first[i + 1]]. */
+struct solver {
+    unsigned int run, width, height;
+    unsigned int stride;        // the number of bytes of a position
+
+    unsigned char* states;
+    uint64_t* keys;             // the game_key of each position
+    unsigned char* outcomes;    // game_outcome of each position
+    uint32_t len, cap, max;
+
+    uint32_t* table;            // indices of positions, by key
+    uint64_t mask;
+
+    uint64_t* first;
+    uint32_t* edges;
+    uint64_t edges_len, edges_cap;
+
+    // the successors of the batch being expanded, width + 2 per position
+    uint32_t batch_lo;
+    unsigned char* next;
+    uint64_t* next_keys;
+    unsigned char* next_len;
+};
+
+typedef struct solver solver;
+
+/* Grows an array so that it has room for at least a number of elements,
+   doubling its capacity.
+
+   @param void* the array
+   @param uint64_t* the capacity of the array, in elements
+   @param uint64_t the number of elements it needs room for
+   @param size_t the size of an element
+   @return void* the array, which may have moved
+   */
+void* grow(void* a, uint64_t* cap, uint64_t need, size_t size) {
+  if (need <= *cap) {
+    return a;
+  }
+  uint64_t c = *cap ? *cap : 1024;
+  while (c < need) {
+    c *= 2;
+  }
+  a = realloc(a, c * size);
+  if (!a) {
+    fprintf(stderr, "grow, unable to allocate %llu elements\n",
+            (unsigned long long) c);
+    exit(1);
+  }
+  *cap = c;
+  return a;
+}
+
+/* Writes the position of a game in the form the solver stores.
+
+   @param solver* the solver
+   @param game* the game
+   @param unsigned char* room for the position
+   */
+void encode(solver* s, game* g, unsigned char* state) {
+  memset(state, 0, s->stride);
+  state[0] = (unsigned char) g->player;
+  posqueue* queues[2] = {g->black_queue, g->white_queue};
+  for (unsigned int k = 0; k < 2; k++) {
+    for (unsigned int i = 0; i < queues[k]->len; i++) {
+      pos p = *posqueue_at(queues[k], i);
+      state[1 + p.r * s->width + p.c] = (unsigned char) (1 + 2 * i + k);
+    }
+  }
+}
+
+/* Sets up a game at a position stored by the solver.
+
+   @param solver* the solver
+   @param unsigned char* the position
+   @param game* the game that we are setting up
+   @param pos* room for the pieces of each player, one cell for each cell
+   of the board
+   */
+void decode(solver* s, const unsigned char* state, game* g, pos* pieces) {
+  unsigned int cells = s->stride - 1, lens[2] = {0, 0};
+  for (unsigned int i = 0; i < cells; i++) {
+    unsigned int v = state[1 + i];
+    if (v) {
+      unsigned int k = (v - 1) & 1, place = (v - 1) >> 1;
+      pieces[k * cells + place] = make_pos(i / s->width, i % s->width);
+      lens[k]++;
+    }
+  }
+  game_set_position(g, pieces, lens[0], pieces + cells, lens[1],
+                    (turn) state[0]);
+}
+
+/* Finds the slot of the table that holds a position, or the empty slot
+   where it would go.
+
+   @param solver* the solver
+   @param unsigned char* the position
+   @param uint64_t the game_key of the position
+   @return uint64_t the slot
+   */
+uint64_t find_slot(solver* s, const unsigned char* state, uint64_t key) {
+  uint64_t slot = (key * 0x9E3779B97F4A7C15ULL) & s->mask;
+  while (s->table[slot] != SOLVE_EMPTY) {
+    uint32_t i = s->table[slot];
+    if (s->keys[i] == key &&
+        memcmp(s->states + (uint64_t) i * s->stride, state, s->stride) == 0) {
+      break;
+    }
+    slot = (slot + 1) & s->mask;
+  }
+  return slot;
+}
+
+/* Doubles the table of positions and inserts every position again.
+
+   @param solver* the solver
+   */
+void grow_table(solver* s) {
+  uint64_t slots = 2 * (s->mask + 1);
+  free(s->table);
+  s->table = (uint32_t*) malloc(slots * sizeof(uint32_t));
+  if (!s->table) {
+    fprintf(stderr, "grow_table, unable to allocate table\n");
+    exit(1);
+  }
+  memset(s->table, 0xFF, slots * sizeof(uint32_t));
+  s->mask = slots - 1;
+  for (uint32_t i = 0; i < s->len; i++) {
+    uint64_t slot = (s->keys[i] * 0x9E3779B97F4A7C15ULL) & s->mask;
+    while (s->table[slot] != SOLVE_EMPTY) {
+      slot = (slot + 1) & s->mask;
+    }
+    s->table[slot] = i;
+  }
+}
+
+/* Finds the number of a position, adding it if it is new.
+
+   @param solver* the solver
+   @param unsigned char* the position
+   @param uint64_t the game_key of the position
+   @return uint32_t the number of the position
+   */
+uint32_t insert(solver* s, const unsigned char* state, uint64_t key) {
+  uint64_t slot = find_slot(s, state, key);
+  if (s->table[slot] != SOLVE_EMPTY) {
+    return s->table[slot];
+  }
+  if (s->len == s->max) {
+    fprintf(stderr, "insert, more than %u positions, raise the limit with "
+            "-M\n", s->max);
+    exit(1);
+  }
+  if (s->len == s->cap) {
+    uint64_t cap = s->cap;
+    s->states = (unsigned char*) grow(s->states, &cap, s->len + 1,
+                                      s->stride);
+    cap = s->cap;
+    s->keys = (uint64_t*) grow(s->keys, &cap, s->len + 1, sizeof(uint64_t));
+    cap = s->cap;
+    s->outcomes = (unsigned char*) grow(s->outcomes, &cap, s->len + 1, 1);
+    s->cap = (uint32_t) (cap < s->max ? cap : s->max);
+  }
+  uint32_t i = s->len++;
+  memcpy(s->states + (uint64_t) i * s->stride, state, s->stride);
+  s->keys[i] = key;
+  s->table[slot] = i;
+  if (2 * (uint64_t) s->len > s->mask + 1) {
+    grow_table(s);
+  }
+  return i;
+}
+
+/* Pool task that expands a chunk of a batch of positions: each position is
+   set up on a game of the chunk, its outcome is stored, and if it is still
+   in progress every legal move is played and the position after it is
+   written to the successors of the batch.
+
+   @param void* the solver
+   @param unsigned int the first position of the chunk, within the batch
+   @param unsigned int one past the last position of the chunk
+   */
+void expand(void* a, unsigned int lo, unsigned int hi) {
+  solver* s = (solver*) a;
+  unsigned int fan = s->width + 2;
+  game* g = new_game(s->run, s->width, s->height, MATRIX);
+  move* moves = (move*) malloc(fan * sizeof(move));
+  pos* pieces = (pos*) malloc(2 * (s->stride - 1) * sizeof(pos));
+  if (!moves || !pieces) {
+    fprintf(stderr, "expand, unable to allocate chunk\n");
+    exit(1);
+  }
+
+  for (unsigned int i = lo; i < hi; i++) {
+    uint32_t index = s->batch_lo + i;
+    decode(s, s->states + (uint64_t) index * s->stride, g, pieces);
+    outcome o = game_outcome(g);
+    s->outcomes[index] = (unsigned char) o;
+    s->next_len[i] = 0;
+    if (o != IN_PROGRESS) {
+      continue;
+    }
+    unsigned int n = legal_moves(g, moves);
+    for (unsigned int k = 0; k < n; k++) {
+      game_make_move(g, moves[k]);
+      uint64_t at = (uint64_t) i * fan + k;
+      encode(s, g, s->next + at * s->stride);
+      s->next_keys[at] = game_key(g);
+      game_unmake_move(g);
+    }
+    s->next_len[i] = (unsigned char) n;
+  }
+
+  free(pieces);
+  free(moves);
+  game_free(g);
+}
+
+/* Finds every position that can be reached from the empty board, in
+   batches: the pool expands a batch in parallel, then its successors are
+   numbered and recorded as edges in order, so positions are found breadth
+   first.
+
+   @param solver* the solver
+   @param pool* the pool that expands the batches
+   */
+void enumerate(solver* s, pool* p) {
+  unsigned int fan = s->width + 2;
+  s->next = (unsigned char*) malloc((uint64_t) SOLVE_BATCH * fan *
+                                    s->stride);
+  s->next_keys = (uint64_t*) malloc((uint64_t) SOLVE_BATCH * fan *
+                                    sizeof(uint64_t));
+  s->next_len = (unsigned char*) malloc(SOLVE_BATCH);
+  if (!s->next || !s->next_keys || !s->next_len) {
+    fprintf(stderr, "enumerate, unable to allocate batch\n");
+    exit(1);
+  }
+
+  game* g = new_game(s->run, s->width, s->height, MATRIX);
+  unsigned char* start = (unsigned char*) malloc(s->stride);
+  if (!start) {
+    fprintf(stderr, "enumerate, unable to allocate position\n");
+    exit(1);
+  }
+  encode(s, g, start);
+  insert(s, start, game_key(g));
+  free(start);
+  game_free(g);
+
+  uint64_t first_cap = 0;
+  for (uint32_t lo = 0; lo < s->len; ) {
+    uint32_t n = s->len - lo < SOLVE_BATCH ? s->len - lo : SOLVE_BATCH;
+    s->batch_lo = lo;
+    pool_run(p, n, expand, s);
+
+    s->first = (uint64_t*) grow(s->first, &first_cap, (uint64_t) lo + n + 1,
+                                sizeof(uint64_t));
+    for (uint32_t i = 0; i < n; i++) {
+      s->first[lo + i] = s->edges_len;
+      s->edges = (uint32_t*) grow(s->edges, &s->edges_cap,
+                                  s->edges_len + s->next_len[i],
+                                  sizeof(uint32_t));
+      for (unsigned int k = 0; k < s->next_len[i]; k++) {
+        uint64_t at = (uint64_t) i * fan + k;
+        s->edges[s->edges_len++] = insert(s, s->next + at * s->stride,
+                                          s->next_keys[at]);
+      }
+    }
+    lo += n;
+    s->first[lo] = s->edges_len;
+  }
+
+  free(s->next);
+  free(s->next_keys);
+  free(s->next_len);
+}
+
+/* Solves every position by retrograde analysis. Finished games are known
+   at once. From there the values spread backwards along the edges in order
+   of distance: a position with a move to a lost position is won, and a
+   position whose moves all lead to won positions is lost once the last of
+   them is known. Working outwards from the finished games finds the
+   quickest win and the slowest loss. Positions that are never reached this
+   way can avoid losing forever, so they are draws.
+
+   @param solver* the solver
+   @param solved* room for the value of every position
+   */
+void retrograde(solver* s, solved* values) {
+  uint32_t n = s->len;
+  // the edges into each position, found by counting and then filling
+  uint64_t* into = (uint64_t*) calloc((uint64_t) n + 1, sizeof(uint64_t));
+  uint32_t* from = (uint32_t*) malloc((s->edges_len ? s->edges_len : 1) *
+                                      sizeof(uint32_t));
+  unsigned char* left = (unsigned char*) malloc(n);
+  uint32_t* queue = (uint32_t*) malloc((uint64_t) n * sizeof(uint32_t));
+  if (!into || !from || !left || !queue) {
+    fprintf(stderr, "retrograde, unable to allocate arrays\n");
+    exit(1);
+  }
+  for (uint64_t e = 0; e < s->edges_len; e++) {
+    into[s->edges[e] + 1]++;
+  }
+  for (uint32_t i = 0; i < n; i++) {
+    into[i + 1] += into[i];
+  }
+  for (uint32_t i = 0; i < n; i++) {
+    for (uint64_t e = s->first[i]; e < s->first[i + 1]; e++) {
+      from[into[s->edges[e]]++] = i;
+    }
+  }
+  // filling moved each start to the end of its position, one place along
+  for (uint32_t i = n; i > 0; i--) {
+    into[i] = into[i - 1];
+  }
+  into[0] = 0;
+
+  uint32_t head = 0, tail = 0;
+  for (uint32_t i = 0; i < n; i++) {
+    left[i] = (unsigned char) (s->first[i + 1] - s->first[i]);
+    values[i].result = SOLVED_UNKNOWN;
+    values[i].distance = 0;
+    outcome o = (outcome) s->outcomes[i];
+    if (o == DRAW) {
+      values[i].result = SOLVED_DRAW;
+    } else if (o != IN_PROGRESS) {
+      bool black_to_move = s->states[(uint64_t) i * s->stride] ==
+                             BLACKS_TURN;
+      values[i].result = (o == BLACK_WIN) == black_to_move ? SOLVED_WIN
+                                                           : SOLVED_LOSS;
+      queue[tail++] = i;
+    }
+  }
+
+  while (head < tail) {
+    uint32_t i = queue[head++];
+    for (uint64_t e = into[i]; e < into[i + 1]; e++) {
+      uint32_t p = from[e];
+      if (values[p].result != SOLVED_UNKNOWN) {
+        continue;
+      }
+      if (values[i].result == SOLVED_LOSS) {
+        values[p].result = SOLVED_WIN;
+      } else if (--left[p] == 0) {
+        values[p].result = SOLVED_LOSS;
+      } else {
+        continue;
+      }
+      values[p].distance = values[i].distance + 1;
+      queue[tail++] = p;
+    }
+  }
+  for (uint32_t i = 0; i < n; i++) {
+    if (values[i].result == SOLVED_UNKNOWN) {
+      values[i].result = SOLVED_DRAW;
+    }
+  }
+
+  free(queue);
+  free(left);
+  free(from);
+  free(into);
+}
+
+/* Solves every position that can be reached on a small board and writes
+   the values to a database file that play and the engine can map. Takes
+   the height, width, and run length with -h, -w, and -r as play does, the
+   path of the file with -o (solved.db by default), the number of threads
+   with -j (every processor by default), and the most positions to store
+   with -M (2^24 by default). Prints the number of positions, how fast they
+   were found, how many are wins, losses, and draws, and the value of the
+   empty board.
+   */
+int main(int argc, char* argv[]) {
+  int h = 0, w = 0, r = 0, threads = 0;
+  long long max = 1LL << 24;
+  char* path = "solved.db";
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-h") == 0 && i + 1 < argc) {
+      h = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+      w = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+      r = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      path = argv[++i];
+    } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+      threads = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-M") == 0 && i + 1 < argc) {
+      max = atoll(argv[++i]);
+    } else {
+      fprintf(stderr, "usage: %s -h HEIGHT -w WIDTH -r RUN [-o FILE] "
+              "[-j THREADS] [-M POSITIONS]\n", argv[0]);
+      exit(1);
+    }
+  }
+
+  if (h < 1 || w < 1 || r < 1) {
+    fprintf(stderr, "solve, a height, width, and run length are "
+            "required\n");
+    exit(1);
+  }
+  // a piece is stored as 1 + 2 * place + owner in one byte
+  if (h * w > 127) {
+    fprintf(stderr, "solve, board too large to solve\n");
+    exit(1);
+  }
+  if (max < 1 || max >= SOLVE_EMPTY) {
+    fprintf(stderr, "solve, position limit out of range\n");
+    exit(1);
+  }
+  // checks the configuration before any thread starts
+  game_free(new_game(r, w, h, MATRIX));
+
+  solver s;
+  memset(&s, 0, sizeof(s));
+  s.run = r;
+  s.width = w;
+  s.height = h;
+  s.stride = h * w + 1;
+  s.max = (uint32_t) max;
+  s.mask = 1023;
+  s.table = (uint32_t*) malloc((s.mask + 1) * sizeof(uint32_t));
+  if (!s.table) {
+    fprintf(stderr, "solve, unable to allocate table\n");
+    exit(1);
+  }
+  memset(s.table, 0xFF, (s.mask + 1) * sizeof(uint32_t));
+
+  pool* p = threads > 0 ? pool_new(threads - 1) : pool_shared();
+  double start = now();
+  enumerate(&s, p);
+  double found = now() - start;
+  if (threads > 0) {
+    pool_free(p);
+  }
+  printf("%u positions, %llu moves in %.3f s: %.0f positions/sec\n",
+         s.len, (unsigned long long) s.edges_len, found,
+         found > 0 ? s.len / found : 0.0);
+
+  solved* values = (solved*) malloc((uint64_t) s.len * sizeof(solved));
+  if (!values) {
+    fprintf(stderr, "solve, unable to allocate values\n");
+    exit(1);
+  }
+  double solving = now();
+  retrograde(&s, values);
+  solving = now() - solving;
+  unsigned long long counts[4] = {0, 0, 0, 0};
+  unsigned int longest = 0;
+  for (uint32_t i = 0; i < s.len; i++) {
+    counts[values[i].result]++;
+    longest = values[i].distance > longest ? values[i].distance : longest;
+  }
+  printf("solved in %.3f s: %llu wins, %llu losses, %llu draws for the "
+         "player to move, longest in %u moves\n", solving,
+         counts[SOLVED_WIN], counts[SOLVED_LOSS], counts[SOLVED_DRAW],
+         longest);
+  static const char* names[] = {"unknown", "win", "loss", "draw"};
+  printf("empty board: %s for black", names[values[0].result]);
+  if (values[0].result != SOLVED_DRAW) {
+    printf(" in %u moves", values[0].distance);
+  }
+  printf("\n");
+
+  solvedb_write(path, r, w, h, s.keys, values, s.len);
+  printf("written to %s\n", path);
+
+  free(values);
+  free(s.table);
+  free(s.states);
+  free(s.keys);
+  free(s.outcomes);
+  free(s.first);
+  free(s.edges);
+  return 0;
+}
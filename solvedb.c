@@ -0,0 +1,229 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "solvedb.h"
+
+/* The first bytes of every database file. */
+#define SOLVEDB_MAGIC "TTSOLVE1"
+
+/* The size of the buffer that a database is written through. */
+#define SOLVEDB_BUFFER (1 << 20)
+
+/* The largest distance a value can hold: the low 14 bits of a value hold
+   the distance and the high 2 bits the result. */
+#define SOLVEDB_MAX_DISTANCE 0x3FFF
+
+
+struct solvedb {
+  const solvedb_header* header;
+  const uint64_t* keys;
+  const uint16_t* values;
+  size_t size;               // the number of bytes that are mapped
+};
+
+/* Finds the key a position is stored under. Empty slots hold 0, so a
+   position whose key is 0 (the empty board with black to move) is stored
+   under 1 instead.
+
+   @param uint64_t the game_key of the position
+   @return uint64_t the key stored in the table
+   */
+uint64_t stored_key(uint64_t key) {
+  return key ? key : 1;
+}
+
+/* Finds the first slot of the table to probe for a key.
+
+   @param uint64_t the stored key
+   @param unsigned int the base two logarithm of the number of slots
+   @return uint64_t the slot
+   */
+uint64_t first_slot(uint64_t key, unsigned int bits) {
+  return (key * 0x9E3779B97F4A7C15ULL) >> (64 - bits);
+}
+
+void solvedb_write(const char* path, unsigned int run, unsigned int width,
+                   unsigned int height, const uint64_t* keys,
+                   const solved* values, size_t count) {
+  unsigned int bits = 1;
+  while (((uint64_t) 1 << bits) < 2 * (uint64_t) count) {
+    bits++;
+  }
+  uint64_t slots = (uint64_t) 1 << bits, mask = slots - 1;
+  uint64_t* table_keys = (uint64_t*) calloc(slots, sizeof(uint64_t));
+  uint16_t* table_values = (uint16_t*) calloc(slots, sizeof(uint16_t));
+  if (!table_keys || !table_values) {
+    fprintf(stderr, "solvedb_write, unable to allocate table\n");
+    exit(1);
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    if (values[i].distance > SOLVEDB_MAX_DISTANCE) {
+      fprintf(stderr, "solvedb_write, distance too large\n");
+      exit(1);
+    }
+    uint64_t key = stored_key(keys[i]);
+    uint64_t s = first_slot(key, bits);
+    while (table_keys[s]) {
+      if (table_keys[s] == key) {
+        fprintf(stderr, "solvedb_write, two positions share a key\n");
+        exit(1);
+      }
+      s = (s + 1) & mask;
+    }
+    table_keys[s] = key;
+    table_values[s] = (uint16_t) ((values[i].result << 14) |
+                                  values[i].distance);
+  }
+
+  solvedb_header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, SOLVEDB_MAGIC, sizeof(header.magic));
+  header.height = height;
+  header.width = width;
+  header.run = run;
+  header.bits = bits;
+  header.count = count;
+
+  FILE* f = fopen(path, "wb");
+  if (!f) {
+    fprintf(stderr, "solvedb_write, unable to open %s\n", path);
+    exit(1);
+  }
+  setvbuf(f, NULL, _IOFBF, SOLVEDB_BUFFER);
+  if (fwrite(&header, sizeof(header), 1, f) != 1 ||
+      fwrite(table_keys, sizeof(uint64_t), slots, f) != slots ||
+      fwrite(table_values, sizeof(uint16_t), slots, f) != slots ||
+      fclose(f) != 0) {
+    fprintf(stderr, "solvedb_write, unable to write %s\n", path);
+    exit(1);
+  }
+  free(table_keys);
+  free(table_values);
+}
+
+solvedb* solvedb_open(const char* path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "solvedb_open, unable to open %s\n", path);
+    exit(1);
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(solvedb_header)) {
+    fprintf(stderr, "solvedb_open, %s is not a database\n", path);
+    exit(1);
+  }
+  size_t size = (size_t) st.st_size;
+  void* map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "solvedb_open, unable to map %s\n", path);
+    exit(1);
+  }
+
+  const solvedb_header* header = (const solvedb_header*) map;
+  if (memcmp(header->magic, SOLVEDB_MAGIC, sizeof(header->magic)) != 0 ||
+      header->bits < 1 || header->bits > 40 ||
+      size != sizeof(solvedb_header) +
+                ((size_t) 1 << header->bits) * (sizeof(uint64_t) +
+                                                sizeof(uint16_t))) {
+    fprintf(stderr, "solvedb_open, %s is not a database\n", path);
+    exit(1);
+  }
+
+  solvedb* res = (solvedb*) malloc(sizeof(solvedb));
+  if (!res) {
+    fprintf(stderr, "solvedb_open, unable to allocate result\n");
+    exit(1);
+  }
+  res->header = header;
+  res->keys = (const uint64_t*) (header + 1);
+  res->values = (const uint16_t*) (res->keys +
+                                   ((size_t) 1 << header->bits));
+  res->size = size;
+  return res;
+}
+
+void solvedb_close(solvedb* db) {
+  munmap((void*) db->header, db->size);
+  free(db);
+}
+
+const solvedb_header* solvedb_info(solvedb* db) {
+  return db->header;
+}
+
+bool solvedb_lookup(solvedb* db, game* g, solved* value) {
+  const solvedb_header* h = db->header;
+  if (g->flipped_len > 0 || g->run != h->run || g->b->width != h->width ||
+      g->b->height != h->height) {
+    return false;
+  }
+  uint64_t key = stored_key(game_key(g));
+  uint64_t mask = ((uint64_t) 1 << h->bits) - 1;
+  for (uint64_t s = first_slot(key, h->bits); db->keys[s];
+       s = (s + 1) & mask) {
+    if (db->keys[s] == key) {
+      value->result = (solved_result) (db->values[s] >> 14);
+      value->distance = db->values[s] & SOLVEDB_MAX_DISTANCE;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool solvedb_best_move(solvedb* db, game* g, move* best, solved* value) {
+  solved here;
+  if (!solvedb_lookup(db, g, &here)) {
+    return false;
+  }
+  move* moves = (move*) malloc((g->b->width + 2) * sizeof(move));
+  if (!moves) {
+    fprintf(stderr, "solvedb_best_move, unable to allocate moves\n");
+    exit(1);
+  }
+  unsigned int n = legal_moves(g, moves);
+  // a lazy disarray would leave columns marked, and the position after it
+  // could not be looked up
+  bool lazy = g->lazy;
+  game_set_lazy(g, false);
+  // ranks the moves so that a lower rank is better: quick wins, then
+  // draws, then slow losses
+  long best_rank = 0;
+  bool found = true;
+  for (unsigned int i = 0; i < n && found; i++) {
+    solved next;
+    game_make_move(g, moves[i]);
+    found = solvedb_lookup(db, g, &next);
+    game_unmake_move(g);
+    if (!found) {
+      break;
+    }
+    long rank;
+    switch (next.result) {
+      case SOLVED_LOSS:
+        rank = next.distance;
+        break;
+      case SOLVED_WIN:
+        rank = 2L * SOLVEDB_MAX_DISTANCE + 1 - next.distance;
+        break;
+      default:
+        rank = SOLVEDB_MAX_DISTANCE + 1;
+        break;
+    }
+    if (i == 0 || rank < best_rank) {
+      best_rank = rank;
+      *best = moves[i];
+    }
+  }
+  game_set_lazy(g, lazy);
+  free(moves);
+  if (found && value) {
+    *value = here;
+  }
+  return found;
+}
@@ -0,0 +1,114 @@
+#ifndef SOLVEDB_H
+#define SOLVEDB_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "logic.h"
+
+
+enum solved_result {
+    SOLVED_UNKNOWN,
+    SOLVED_WIN,
+    SOLVED_LOSS,
+    SOLVED_DRAW
+};
+
+typedef enum solved_result solved_result;
+
+
+/* The value of a position under perfect play, for the player whose turn it
+   is: whether they win, lose, or draw, and in how many moves the win or
+   loss comes about (0 when the game is already over). */
+struct solved {
+    solved_result result;
+    unsigned int distance;
+};
+
+typedef struct solved solved;
+
+
+/* The start of a database file. It is followed by 2^bits keys of 64 bits,
+   then 2^bits values of 16 bits, which together form an open addressing
+   table indexed by game_key. */
+struct solvedb_header {
+    char magic[8];
+    uint32_t height, width, run, bits;
+    uint64_t count;
+};
+
+typedef struct solvedb_header solvedb_header;
+
+
+struct solvedb;
+
+typedef struct solvedb solvedb;
+
+/* Writes a database of solved positions to a file. The keys are spread
+   over a table with at least twice as many slots as positions, and the
+   file is written through one large buffer. The function raises an error
+   if two positions share a key, if a distance does not fit in the file, or
+   if the file cannot be written.
+
+   @param char* the path of the file
+   @param unsigned int the number of cells in a row to make a run
+   @param unsigned int the number of columns of the board
+   @param unsigned int the number of rows of the board
+   @param uint64_t* the game_key of every position
+   @param solved* the value of every position
+   @param size_t the number of positions
+   */
+void solvedb_write(const char* path, unsigned int run, unsigned int width,
+                   unsigned int height, const uint64_t* keys,
+                   const solved* values, size_t count);
+
+/* Opens a database file by mapping it into memory, so that a lookup reads
+   the table in place and only the pages it touches are ever loaded. The
+   function raises an error if the file cannot be mapped or is not a
+   database.
+
+   @param char* the path of the file
+   @return solvedb* a pointer to the opened database
+   */
+solvedb* solvedb_open(const char* path);
+
+/* Unmaps a database file and deallocates the database.
+
+   @param solvedb* the database that we are closing
+   */
+void solvedb_close(solvedb* db);
+
+/* Reads the board size and run length a database was solved for.
+
+   @param solvedb* the database
+   @return solvedb_header* the header of the file
+   */
+const solvedb_header* solvedb_info(solvedb* db);
+
+/* Looks up the value of the position of a game in O(1). A position is only
+   found if the game has the board size and run length of the database and
+   no columns are marked as flipped by a lazy disarray, since those change
+   the key of the game.
+
+   @param solvedb* the database that we are looking in
+   @param game* the game whose position we are looking up
+   @param solved* where the value of the position is stored
+   @return bool true if the position was found, otherwise false
+   */
+bool solvedb_lookup(solvedb* db, game* g, solved* value);
+
+/* Finds a move of perfect play by looking up the position after each legal
+   move: the quickest win if there is one, otherwise a draw, otherwise the
+   slowest loss. The moves are played without lazy disarray and taken back,
+   so the game is left as it was.
+
+   @param solvedb* the database that we are looking in
+   @param game* the game that we are finding a move for, still in progress
+   @param move* where the move is stored
+   @param solved* where the value of the position is stored, or NULL if it
+   is not needed
+   @return bool true if the position and every position after it were
+   found, otherwise false
+   */
+bool solvedb_best_move(solvedb* db, game* g, move* best, solved* value);
+
+#endif /* SOLVEDB_H */
@@ -0,0 +1,53 @@
+#include "step.h"
+#include "board.h"
+
+bool parse_move(char input, move* m) {
+  m->column = 0;
+  if (input == '!') {
+    m->type = MOVE_OFFSET;
+  } else if (input == '^') {
+    m->type = MOVE_DISARRAY;
+  } else if ('0' <= input && input <= '9') {
+    *m = (move) {MOVE_DROP, input - '0'};
+  } else if ('A' <= input && input <= 'Z') {
+    *m = (move) {MOVE_DROP, 10 + input - 'A'};
+  } else if ('a' <= input && input <= 'z') {
+    *m = (move) {MOVE_DROP, 36 + input - 'a'};
+  } else {
+    return false;
+  }
+  return true;
+}
+
+char move_label(move m) {
+  switch (m.type) {
+    case MOVE_DROP:
+      return find_label(m.column);
+    case MOVE_DISARRAY:
+      return '^';
+    default:
+      return '!';
+  }
+}
+
+bool apply_move(game* g, move m) {
+  switch (m.type) {
+    case MOVE_DROP:
+      return drop_piece(g, m.column);
+    case MOVE_OFFSET:
+      return offset(g);
+    default:
+      disarray(g);
+      return true;
+  }
+}
+
+step_result game_step(game* g, char input, move* played) {
+  if (!parse_move(input, played)) {
+    return STEP_INVALID;
+  }
+  if (game_outcome(g) != IN_PROGRESS) {
+    return STEP_OVER;
+  }
+  return apply_move(g, *played) ? STEP_PLAYED : STEP_ILLEGAL;
+}
@@ -0,0 +1,56 @@
+#ifndef STEP_H
+#define STEP_H
+
+#include <stdbool.h>
+#include "logic.h"
+
+
+enum step_result {
+    STEP_PLAYED,
+    STEP_INVALID,
+    STEP_ILLEGAL,
+    STEP_OVER
+};
+
+typedef enum step_result step_result;
+
+/* Reads the character a move is entered with: the label of a column for a
+   drop (0-9, A-Z, a-z), ^ for a disarray, or ! for an offset.
+
+   @param char the character
+   @param move* where the move is stored
+   @return bool false if the character is not a move, otherwise true
+   */
+bool parse_move(char input, move* m);
+
+/* Finds the character a move is entered with, the reverse of parse_move.
+
+   @param move the move
+   @return char the label of the column of a drop, ^, or !
+   */
+char move_label(move m);
+
+/* Plays a move with drop_piece, disarray, or offset, which keep no undo
+   records, so a game of any length can be played without growing the
+   undo stack.
+
+   @param game* the game that we are playing the move in
+   @param move the move
+   @return bool false if the move is illegal, otherwise true
+   */
+bool apply_move(game* g, move m);
+
+/* Plays one move of a game from the character it is entered with. This is
+   one step of the game loop, shared by the interactive game, batch games,
+   and the server. Nothing is changed unless the move is played.
+
+   @param game* the game that we are playing
+   @param char the character of the move
+   @param move* where the move is stored if the character is a move
+   @return step_result STEP_PLAYED if the move was played, STEP_INVALID if
+   the character is not a move, STEP_ILLEGAL if the move is not legal, or
+   STEP_OVER if the game is already over
+   */
+step_result game_step(game* g, char input, move* played);
+
+#endif /* STEP_H */
@@ -1,16 +1,26 @@
 #include <criterion/criterion.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "pos.h"
 #include "board.h"
 #include "logic.h"
+#include "pool.h"
+#include "engine.h"
+#include "mcts.h"
+#include "arena.h"
+#include "solvedb.h"
+#include "record.h"
+#include "step.h"
+#include "batch.h"
 
 // pos.c tests
 Test(posqueue_new, create_queue) {
   posqueue* q = posqueue_new();
   cr_assert_not_null(q);
-  cr_assert_null(q->head);
-  cr_assert_null(q->tail);
+  cr_assert_eq(q->head, 0);
   cr_assert_eq(q->len, 0);
   posqueue_free(q);
 }
@@ -18,10 +28,9 @@ Test(posqueue_new, create_queue) {
 Test(pos_enqueue, single_element) {
   posqueue* q = posqueue_new();
   pos_enqueue(q, make_pos(0,0));
-  cr_assert_eq(q->head, q->tail);
   cr_assert_eq(q->len, 1);
-  cr_assert_eq(q->head->p.r, 0);
-  cr_assert_eq(q->head->p.c, 0);
+  cr_assert_eq(posqueue_at(q, 0)->r, 0);
+  cr_assert_eq(posqueue_at(q, 0)->c, 0);
   posqueue_free(q);
 }
 
@@ -30,10 +39,10 @@ Test(pos_enqueue, multiple_elements) {
   pos_enqueue(q, make_pos(1,7));
   pos_enqueue(q, make_pos(9,20));
   cr_assert_eq(q->len, 2);
-  cr_assert_eq(q->head->p.r, 1);
-  cr_assert_eq(q->head->p.c, 7);
-  cr_assert_eq(q->tail->p.r, 9);
-  cr_assert_eq(q->tail->p.c, 20);
+  cr_assert_eq(posqueue_at(q, 0)->r, 1);
+  cr_assert_eq(posqueue_at(q, 0)->c, 7);
+  cr_assert_eq(posqueue_at(q, 1)->r, 9);
+  cr_assert_eq(posqueue_at(q, 1)->c, 20);
   posqueue_free(q);
 }
 
@@ -45,8 +54,6 @@ Test(pos_dequeue, length_one) {
   cr_assert_eq(result.r, 0);
   cr_assert_eq(result.c, 0);
   cr_assert_eq(q->len, 0);
-  cr_assert_null(q->head);
-  cr_assert_null(q->tail);
   posqueue_free(q);
 }
 
@@ -60,8 +67,8 @@ Test(pos_dequeue, length_multiple) {
   cr_assert_eq(result.r, 1);
   cr_assert_eq(result.c, 1);
   cr_assert_eq(q->len, 1);
-  cr_assert_eq(q->head->p.r, 2);
-  cr_assert_eq(q->head->p.c, 2);
+  cr_assert_eq(posqueue_at(q, 0)->r, 2);
+  cr_assert_eq(posqueue_at(q, 0)->c, 2);
   posqueue_free(q);
 }
 
@@ -73,8 +80,6 @@ Test(posqueue_remback, length_one) {
   cr_assert_eq(result.r, 0);
   cr_assert_eq(result.c, 0);
   cr_assert_eq(q->len, 0);
-  cr_assert_null(q->head);
-  cr_assert_null(q->tail);
   posqueue_free(q);
 }
 
@@ -88,11 +93,83 @@ Test(posqueue_remback, length_multiple) {
   cr_assert_eq(result.r, 2);
   cr_assert_eq(result.c, 2);
   cr_assert_eq(q->len, 1);
-  cr_assert_eq(q->tail->p.r, 1);
-  cr_assert_eq(q->tail->p.c, 1);
+  cr_assert_eq(posqueue_at(q, q->len - 1)->r, 1);
+  cr_assert_eq(posqueue_at(q, q->len - 1)->c, 1);
   posqueue_free(q);
 }
 
+Test(posqueue_at, wraps_around) {
+  posqueue* q = posqueue_new();
+  posqueue_reserve(q, 4);
+  for (unsigned int i = 0; i < 4; i++) {
+    pos_enqueue(q, make_pos(i, i));
+  }
+  pos_dequeue(q);
+  pos_dequeue(q);
+  pos_enqueue(q, make_pos(4, 4));
+  pos_enqueue(q, make_pos(5, 5));
+  cr_assert_eq(q->cap, 4);
+  cr_assert_eq(q->len, 4);
+  for (unsigned int i = 0; i < 4; i++) {
+    cr_assert_eq(posqueue_at(q, i)->r, i + 2);
+  }
+  posqueue_at(q, 3)->c = 9;
+  cr_assert_eq(posqueue_remback(q).c, 9);
+  posqueue_free(q);
+}
+
+Test(pos_enqueue, grows_when_full) {
+  posqueue* q = posqueue_new();
+  for (unsigned int i = 0; i < 5; i++) {
+    pos_enqueue(q, make_pos(i, 0));
+  }
+  for (unsigned int i = 0; i < 3; i++) {
+    cr_assert_eq(pos_dequeue(q).r, i);
+  }
+  for (unsigned int i = 5; i < 100; i++) {
+    pos_enqueue(q, make_pos(i, 0));
+  }
+  cr_assert_eq(q->len, 97);
+  for (unsigned int i = 0; i < q->len; i++) {
+    cr_assert_eq(posqueue_at(q, i)->r, i + 3);
+  }
+  posqueue_free(q);
+}
+
+Test(posqueue_addfront, undoes_dequeue) {
+  posqueue* q = posqueue_new();
+  pos_enqueue(q, make_pos(1, 1));
+  pos_enqueue(q, make_pos(2, 2));
+  pos p = pos_dequeue(q);
+  posqueue_addfront(q, p);
+  cr_assert_eq(q->len, 2);
+  cr_assert_eq(posqueue_at(q, 0)->r, 1);
+  cr_assert_eq(posqueue_at(q, 1)->r, 2);
+  posqueue_addfront(q, make_pos(0, 0));
+  cr_assert_eq(posqueue_at(q, 0)->r, 0);
+  cr_assert_eq(posqueue_remback(q).r, 2);
+  posqueue_free(q);
+}
+
+Test(posqueue_set, key_follows_order) {
+  posqueue* q1 = posqueue_new();
+  posqueue* q2 = posqueue_new();
+  pos_enqueue(q1, make_pos(1, 1));
+  pos_enqueue(q1, make_pos(2, 2));
+  pos_enqueue(q2, make_pos(2, 2));
+  pos_enqueue(q2, make_pos(1, 1));
+  cr_assert_neq(q1->key, q2->key);
+  posqueue_set(q2, 0, make_pos(1, 1));
+  posqueue_set(q2, 1, make_pos(2, 2));
+  cr_assert_eq(q1->key, q2->key);
+  pos_dequeue(q1);
+  posqueue_remback(q2);
+  posqueue_set(q2, 0, make_pos(2, 2));
+  cr_assert_eq(q1->key, q2->key);
+  posqueue_free(q1);
+  posqueue_free(q2);
+}
+
 Test(posqueue_free, empty_queue) {
   posqueue* q = posqueue_new();
   posqueue_free(q);
@@ -105,6 +182,44 @@ Test(posqueue_free, non_empty_queue) {
   posqueue_free(q);
 }
 
+// pool.c tests
+void count_items(void* arg, unsigned int lo, unsigned int hi) {
+  unsigned int* counts = (unsigned int*) arg;
+  for (unsigned int i = lo; i < hi; i++) {
+    __atomic_fetch_add(&counts[i], 1, __ATOMIC_RELAXED);
+  }
+}
+
+Test(pool_run, every_item_once) {
+  pool* p = pool_new(4);
+  unsigned int counts[1000] = {0};
+  for (unsigned int round = 0; round < 50; round++) {
+    pool_run(p, 1000, count_items, counts);
+  }
+  for (unsigned int i = 0; i < 1000; i++) {
+    cr_assert_eq(counts[i], 50);
+  }
+  pool_free(p);
+}
+
+Test(pool_run, fewer_items_than_workers) {
+  pool* p = pool_new(8);
+  unsigned int counts[3] = {0};
+  pool_run(p, 3, count_items, counts);
+  pool_run(NULL, 3, count_items, counts);
+  for (unsigned int i = 0; i < 3; i++) {
+    cr_assert_eq(counts[i], 2);
+  }
+  pool_free(p);
+}
+
+Test(pool_workers, counts_workers) {
+  pool* p = pool_new(3);
+  cr_assert_eq(pool_workers(p), 3);
+  cr_assert_eq(pool_workers(NULL), 0);
+  pool_free(p);
+}
+
 // board.c tests
 Test(board_new, small_board) {
   board* b = board_new(5, 5, MATRIX);
@@ -115,7 +230,7 @@ Test(board_new, small_board) {
 
   for (unsigned int r = 0; r < 5; r++) {
     for (unsigned int c = 0; c < 5; c++) {
-      cr_assert_eq(b->u.matrix[r][c], EMPTY);
+      cr_assert_eq(b->u.matrix[r * b->stride + c], EMPTY);
     }
   }
   board_free(b);
@@ -130,12 +245,95 @@ Test(board_new, large_board) {
 
   for (unsigned int r = 0; r < 20000; r++) {
     for (unsigned int c = 0; c < 20000; c++) {
-      cr_assert_eq(b->u.matrix[r][c], EMPTY);
+      cr_assert_eq(b->u.matrix[r * b->stride + c], EMPTY);
     }
   }
   board_free(b);
 }
 
+Test(board_new, matrix_layout) {
+  board* b = board_new(62, 62, MATRIX);
+  cr_assert_eq((uintptr_t) b->u.matrix % 64, 0);
+  cr_assert_geq(b->stride, 62);
+  cr_assert_leq(b->stride * 62, 4096);
+  board_set(b, make_pos(1, 0), WHITE);
+  board_set(b, make_pos(0, 61), BLACK);
+  cr_assert_eq(b->u.matrix[b->stride], WHITE);
+  cr_assert_eq(b->u.matrix[61], BLACK);
+  for (unsigned int i = 62; i < b->stride; i++) {
+    cr_assert_eq(b->u.matrix[i], EMPTY);
+  }
+  board_free(b);
+}
+
+/* Looks for a run by checking every line of cells one at a time.
+
+   @param board* the board that we are checking
+   @param cell the player whose run we are looking for
+   @param unsigned int the length of the run
+   @return bool true if the player has a run
+   */
+bool brute_has_run(board* b, cell player, unsigned int run) {
+  int dirs[4][2] = {{0, 1}, {1, 0}, {1, 1}, {1, -1}};
+  for (int r = 0; r < (int) b->height; r++) {
+    for (int c = 0; c < (int) b->width; c++) {
+      for (unsigned int d = 0; d < 4; d++) {
+        unsigned int count = 0;
+        int cur_r = r, cur_c = c;
+        while (count < run && cur_r >= 0 && cur_c >= 0 &&
+               cur_r < (int) b->height && cur_c < (int) b->width &&
+               board_get(b, make_pos(cur_r, cur_c)) == player) {
+          count++;
+          cur_r += dirs[d][0];
+          cur_c += dirs[d][1];
+        }
+        if (count == run) {
+          return true;
+        }
+      }
+    }
+  }
+  return false;
+}
+
+Test(matrix_has_run, kernels_match_brute_force) {
+  srand(7);
+  for (unsigned int trial = 0; trial < 300; trial++) {
+    unsigned int w = 1 + rand() % 64, h = 1 + rand() % 200;
+    unsigned int run = 1 + rand() % 6;
+    board* b = board_new(w, h, MATRIX);
+    unsigned int density = rand() % 5;
+    for (unsigned int r = 0; r < h; r++) {
+      for (unsigned int c = 0; c < w; c++) {
+        board_set(b, make_pos(r, c), rand() % 4 < density ? 1 + rand() % 2 
+                                                          : EMPTY);
+      }
+    }
+    bool black = brute_has_run(b, BLACK, run);
+    bool white = brute_has_run(b, WHITE, run);
+    for (int level = SIMD_SCALAR; level <= SIMD_AVX2; level++) {
+      matrix_simd(level);
+      cr_assert_eq(matrix_has_run(b, BLACK, run), black);
+      cr_assert_eq(matrix_has_run(b, WHITE, run), white);
+      cr_assert_eq(matrix_full(b), density == 4);
+    }
+    board_free(b);
+  }
+}
+
+Test(matrix_has_run, long_diagonal) {
+  board* b = board_new(64, 64, MATRIX);
+  for (unsigned int i = 0; i < 64; i++) {
+    board_set(b, make_pos(i, 63 - i), WHITE);
+  }
+  cr_assert(matrix_has_run(b, WHITE, 64));
+  cr_assert_not(matrix_has_run(b, BLACK, 1));
+  board_set(b, make_pos(40, 23), EMPTY);
+  cr_assert(matrix_has_run(b, WHITE, 40));
+  cr_assert_not(matrix_has_run(b, WHITE, 41));
+  board_free(b);
+}
+
 Test(board_free, empty_board) {
   board* b = board_new(5, 5, MATRIX);
   board_free(b);
@@ -147,7 +345,7 @@ Test(board_get, random_position) {
   pos p = make_pos(3,6);
   cr_assert_eq(board_get(b, p), EMPTY);
   cell temp = BLACK;
-  b->u.matrix[p.r][p.c] = temp; 
+  b->u.matrix[p.r * b->stride + p.c] = temp; 
   cr_assert_eq(board_get(b, p), BLACK);
   board_free(b);
 }
@@ -178,6 +376,122 @@ Test(board_set, corner_case) {
   board_free(b);
 }
 
+void reverse_columns(void* arg, unsigned int lo, unsigned int hi) {
+  board* b = (board*) arg;
+  for (unsigned int c = lo; c < hi; c++) {
+    for (unsigned int r = 0; r < b->height / 2; r++) {
+      board_swap(b, make_pos(r, c), make_pos(b->height - 1 - r, c));
+    }
+  }
+}
+
+Test(board_swap, parallel_columns) {
+  enum type types[4] = {MATRIX, BITS, BITBOARD, COLUMNS};
+  pool* p = pool_new(4);
+  for (unsigned int t = 0; t < 4; t++) {
+    board* b = board_new(61, 37, types[t]);
+    for (unsigned int r = 0; r < 37; r++) {
+      for (unsigned int c = 0; c < 61; c++) {
+        board_set(b, make_pos(r, c), (r * 7 + c * 3) % 3);
+      }
+    }
+    pool_run(p, 61, reverse_columns, b);
+    for (unsigned int r = 0; r < 37; r++) {
+      for (unsigned int c = 0; c < 61; c++) {
+        cr_assert_eq(board_get(b, make_pos(36 - r, c)), (r * 7 + c * 3) % 3);
+      }
+    }
+    board_free(b);
+  }
+  pool_free(p);
+}
+
+Test(board_fall, matches_every_type) {
+  enum type types[4] = {MATRIX, BITS, BITBOARD, COLUMNS};
+  unsigned int heights[2] = {7, 40};
+  for (unsigned int k = 0; k < 2; k++) {
+    unsigned int h = heights[k];
+    board* boards[4];
+    for (unsigned int t = 0; t < 4; t++) {
+      boards[t] = board_new(3, h, types[t]);
+      for (unsigned int r = 2; r < h; r++) {
+        board_set(boards[t], make_pos(r, 1), 1 + (r * r) % 2);
+      }
+      board_fall(boards[t], make_pos(4, 1), 2);
+      board_reverse_column(boards[t], 1, h - 3);
+      board_rise(boards[t], make_pos(h - 2, 1), 3, WHITE);
+      board_fall(boards[t], make_pos(h - 1, 1), 2);
+    }
+    for (unsigned int t = 1; t < 4; t++) {
+      cr_assert_eq(boards[t]->key, boards[0]->key);
+      for (unsigned int r = 0; r < h; r++) {
+        cr_assert_eq(board_get(boards[t], make_pos(r, 1)), 
+                     board_get(boards[0], make_pos(r, 1)));
+      }
+    }
+    for (unsigned int t = 0; t < 4; t++) {
+      board_free(boards[t]);
+    }
+  }
+}
+
+Test(board_fall, columns_across_words) {
+  unsigned int heights[5] = {32, 33, 64, 65, 130};
+  for (unsigned int k = 0; k < 5; k++) {
+    unsigned int h = heights[k];
+    board* m = board_new(2, h, MATRIX);
+    board* c = board_new(2, h, COLUMNS);
+    unsigned int count = 0, seed = h;
+    for (unsigned int step = 0; step < 400; step++) {
+      seed = seed * 1103515245 + 12345;
+      unsigned int pick = (seed >> 8) % 4;
+      if (count < h && (pick == 0 || count < 2)) {
+        pos p = make_pos(h - 1 - count, 0);
+        board_set(m, p, 1 + (seed >> 20) % 2);
+        board_set(c, p, 1 + (seed >> 20) % 2);
+        count++;
+      } else if (pick == 1) {
+        board_reverse_column(m, 0, count);
+        board_reverse_column(c, 0, count);
+      } else if (pick == 2) {
+        pos p = make_pos(h - 1 - (seed >> 12) % count, 0);
+        board_fall(m, p, h - count);
+        board_fall(c, p, h - count);
+        count--;
+      } else if (count < h) {
+        pos p = make_pos(h - 1 - (seed >> 12) % count, 0);
+        cell piece = 1 + (seed >> 20) % 2;
+        board_rise(m, p, h - count, piece);
+        board_rise(c, p, h - count, piece);
+        count++;
+      }
+      cr_assert_eq(c->key, m->key);
+      for (unsigned int r = 0; r < h; r++) {
+        cr_assert_eq(board_get(c, make_pos(r, 0)), 
+                     board_get(m, make_pos(r, 0)));
+        cr_assert_eq(board_get(c, make_pos(r, 1)), EMPTY);
+      }
+    }
+    board_free(m);
+    board_free(c);
+  }
+}
+
+Test(board_new, columns_layout) {
+  board* b = board_new(3, 5, COLUMNS);
+  cr_assert_eq(b->stride, 1);
+  board_set(b, make_pos(4, 0), BLACK);
+  board_set(b, make_pos(3, 0), WHITE);
+  board_set(b, make_pos(4, 2), WHITE);
+  cr_assert_eq(b->u.columns[0], BLACK | (WHITE << 2));
+  cr_assert_eq(b->u.columns[1], 0);
+  cr_assert_eq(b->u.columns[2], WHITE);
+  board_free(b);
+  b = board_new(2, 33, COLUMNS);
+  cr_assert_eq(b->stride, 2);
+  board_free(b);
+}
+
 Test(board_show, show_empty_board) {
   board* b = board_new(5, 5, MATRIX);
   //board_show(b);
@@ -201,6 +515,42 @@ Test(board_show, board_with_pieces) {
   cr_assert(1);
 }
 
+Test(board_render, renders_labels_and_cells) {
+  board* b = board_new(3, 2, COLUMNS);
+  board_set(b, make_pos(1, 0), BLACK);
+  board_set(b, make_pos(1, 2), WHITE);
+  char out[32];
+  size_t n = board_render(b, out);
+  cr_assert_eq(n, board_render_size(3, 2));
+  out[n] = '\0';
+  cr_assert_str_eq(out, "  012\n0 ...\n1 *.o\n");
+  board_free(b);
+}
+
+Test(board_view, draws_only_changed_cells) {
+  int fds[2];
+  cr_assert_eq(pipe(fds), 0);
+  board* b = board_new(3, 2, MATRIX);
+  board_view* v = board_view_new(3, 2, fds[1]);
+  char out[256];
+  board_view_draw(v, b);
+  ssize_t n = read(fds[0], out, sizeof(out) - 1);
+  out[n] = '\0';
+  cr_assert_str_eq(out, "\x1b[2J\x1b[H  012\n0 ...\n1 ...\n"
+                        "\x1b[4;1H\x1b[J");
+
+  board_set(b, make_pos(1, 1), BLACK);
+  board_set(b, make_pos(1, 2), WHITE);
+  board_view_draw(v, b);
+  n = read(fds[0], out, sizeof(out) - 1);
+  out[n] = '\0';
+  cr_assert_str_eq(out, "\x1b[3;4H*o\x1b[4;1H\x1b[J");
+  board_view_free(v);
+  board_free(b);
+  close(fds[0]);
+  close(fds[1]);
+}
+
 // tests for logic.c
 Test(new_game, create_valid_game) {
   game* g = new_game(4, 5, 5, MATRIX);
@@ -256,6 +606,21 @@ Test(drop_piece, drop_into_full_column) {
   game_free(g);
 }
 
+Test(drop_piece, column_heights) {
+  game* g = new_game(4, 5, 5, MATRIX);
+  drop_piece(g, 2);
+  drop_piece(g, 2);
+  drop_piece(g, 4);
+  cr_assert_eq(g->col_height[0], 0);
+  cr_assert_eq(g->col_height[2], 2);
+  cr_assert_eq(g->col_height[4], 1);
+  disarray(g);
+  cr_assert_eq(g->col_height[2], 2);
+  cr_assert(offset(g));
+  cr_assert_eq(g->col_height[2] + g->col_height[4], 1);
+  game_free(g);
+}
+
 Test(disarray, empty_board) {
   game* g = new_game(4, 5, 5, MATRIX);
   disarray(g);
@@ -306,29 +671,23 @@ Test(disarray, pieces_in_multiple_columns) {
   cr_assert_eq(board_get(g->b, make_pos(4, 3)), WHITE);
   cr_assert_eq(board_get(g->b, make_pos(3, 3)), BLACK);
   
-  cr_assert_eq(g->black_queue->head->p.c, 0);
-  cr_assert_eq(g->black_queue->head->p.r, 4);
-  g->black_queue->head = g->black_queue->head->next;
+  cr_assert_eq(posqueue_at(g->black_queue, 0)->c, 0);
+  cr_assert_eq(posqueue_at(g->black_queue, 0)->r, 4);
   
-  cr_assert_eq(g->black_queue->head->p.c, 1);
-  cr_assert_eq(g->black_queue->head->p.r, 4);
-  g->black_queue->head = g->black_queue->head->next;
+  cr_assert_eq(posqueue_at(g->black_queue, 1)->c, 1);
+  cr_assert_eq(posqueue_at(g->black_queue, 1)->r, 4);
 
-  cr_assert_eq(g->white_queue->head->p.c, 1);
-  cr_assert_eq(g->white_queue->head->p.r, 3);
-  g->white_queue->head = g->white_queue->head->next;
+  cr_assert_eq(posqueue_at(g->white_queue, 0)->c, 1);
+  cr_assert_eq(posqueue_at(g->white_queue, 0)->r, 3);
 
-  cr_assert_eq(g->black_queue->head->p.c, 3);
-  cr_assert_eq(g->black_queue->head->p.r, 3);
-  g->black_queue->head = g->black_queue->head->next;
+  cr_assert_eq(posqueue_at(g->black_queue, 2)->c, 3);
+  cr_assert_eq(posqueue_at(g->black_queue, 2)->r, 3);
 
-  cr_assert_eq(g->white_queue->head->p.c, 2);
-  cr_assert_eq(g->white_queue->head->p.r, 4);
-  g->white_queue->head = g->white_queue->head->next;
+  cr_assert_eq(posqueue_at(g->white_queue, 1)->c, 2);
+  cr_assert_eq(posqueue_at(g->white_queue, 1)->r, 4);
 
-  cr_assert_eq(g->white_queue->head->p.c, 3);
-  cr_assert_eq(g->white_queue->head->p.r, 4);
-  g->white_queue->head = g->white_queue->head->next;
+  cr_assert_eq(posqueue_at(g->white_queue, 2)->c, 3);
+  cr_assert_eq(posqueue_at(g->white_queue, 2)->r, 4);
 
   game_free(g);
 }
@@ -382,45 +741,35 @@ Test(disarray, check_queues) {
   cr_assert_eq(board_get(g->b, make_pos(1, 2)), EMPTY);
   cr_assert_eq(board_get(g->b, make_pos(0, 2)), EMPTY);
   
-  cr_assert_eq(g->black_queue->head->p.c, 0);
-  cr_assert_eq(g->black_queue->head->p.r, 0);
-  g->black_queue->head = g->black_queue->head->next;
+  cr_assert_eq(posqueue_at(g->black_queue, 0)->c, 0);
+  cr_assert_eq(posqueue_at(g->black_queue, 0)->r, 0);
 
-  cr_assert_eq(g->white_queue->head->p.c, 0);
-  cr_assert_eq(g->white_queue->head->p.r, 1);
-  g->white_queue->head = g->white_queue->head->next;
+  cr_assert_eq(posqueue_at(g->white_queue, 0)->c, 0);
+  cr_assert_eq(posqueue_at(g->white_queue, 0)->r, 1);
   
-  cr_assert_eq(g->black_queue->head->p.c, 1);
-  cr_assert_eq(g->black_queue->head->p.r, 1);
-  g->black_queue->head = g->black_queue->head->next;
+  cr_assert_eq(posqueue_at(g->black_queue, 1)->c, 1);
+  cr_assert_eq(posqueue_at(g->black_queue, 1)->r, 1);
 
-  cr_assert_eq(g->white_queue->head->p.c, 2);
-  cr_assert_eq(g->white_queue->head->p.r, 4);
-  g->white_queue->head = g->white_queue->head->next;
+  cr_assert_eq(posqueue_at(g->white_queue, 1)->c, 2);
+  cr_assert_eq(posqueue_at(g->white_queue, 1)->r, 4);
 
-  cr_assert_eq(g->black_queue->head->p.c, 1);
-  cr_assert_eq(g->black_queue->head->p.r, 2);
-  g->black_queue->head = g->black_queue->head->next;
+  cr_assert_eq(posqueue_at(g->black_queue, 2)->c, 1);
+  cr_assert_eq(posqueue_at(g->black_queue, 2)->r, 2);
 
-  cr_assert_eq(g->white_queue->head->p.c, 0);
-  cr_assert_eq(g->white_queue->head->p.r, 2);
-  g->white_queue->head = g->white_queue->head->next;
+  cr_assert_eq(posqueue_at(g->white_queue, 2)->c, 0);
+  cr_assert_eq(posqueue_at(g->white_queue, 2)->r, 2);
 
-  cr_assert_eq(g->black_queue->head->p.c, 0);
-  cr_assert_eq(g->black_queue->head->p.r, 3);
-  g->black_queue->head = g->black_queue->head->next;
+  cr_assert_eq(posqueue_at(g->black_queue, 3)->c, 0);
+  cr_assert_eq(posqueue_at(g->black_queue, 3)->r, 3);
 
-  cr_assert_eq(g->white_queue->head->p.c, 1);
-  cr_assert_eq(g->white_queue->head->p.r, 3);
-  g->white_queue->head = g->white_queue->head->next;
+  cr_assert_eq(posqueue_at(g->white_queue, 3)->c, 1);
+  cr_assert_eq(posqueue_at(g->white_queue, 3)->r, 3);
 
-  cr_assert_eq(g->black_queue->head->p.c, 0);
-  cr_assert_eq(g->black_queue->head->p.r, 4);
-  g->black_queue->head = g->black_queue->head->next;
+  cr_assert_eq(posqueue_at(g->black_queue, 4)->c, 0);
+  cr_assert_eq(posqueue_at(g->black_queue, 4)->r, 4);
 
-  cr_assert_eq(g->white_queue->head->p.c, 1);
-  cr_assert_eq(g->white_queue->head->p.r, 4);
-  g->white_queue->head = g->white_queue->head->next;
+  cr_assert_eq(posqueue_at(g->white_queue, 4)->c, 1);
+  cr_assert_eq(posqueue_at(g->white_queue, 4)->r, 4);
 
   game_free(g);
 }
@@ -536,38 +885,48 @@ Test(offset, both_one_col) {
   cr_assert_eq(board_get(g->b, make_pos(1, 2)), EMPTY);
   cr_assert_eq(board_get(g->b, make_pos(0, 2)), EMPTY);
   
-  cr_assert_eq(g->black_queue->head->p.c, 0);
-  cr_assert_eq(g->black_queue->head->p.r, 2);
-  g->black_queue->head = g->black_queue->head->next;
+  cr_assert_eq(posqueue_at(g->black_queue, 0)->c, 0);
+  cr_assert_eq(posqueue_at(g->black_queue, 0)->r, 2);
   
-  cr_assert_eq(g->black_queue->head->p.c, 1);
-  cr_assert_eq(g->black_queue->head->p.r, 1);
-  g->black_queue->head = g->black_queue->head->next;
+  cr_assert_eq(posqueue_at(g->black_queue, 1)->c, 1);
+  cr_assert_eq(posqueue_at(g->black_queue, 1)->r, 1);
+
+  cr_assert_eq(posqueue_at(g->white_queue, 0)->c, 2);
+  cr_assert_eq(posqueue_at(g->white_queue, 0)->r, 4);
 
-  cr_assert_eq(g->white_queue->head->p.c, 2);
-  cr_assert_eq(g->white_queue->head->p.r, 4);
-  g->white_queue->head = g->white_queue->head->next;
+  cr_assert_eq(posqueue_at(g->black_queue, 2)->c, 1);
+  cr_assert_eq(posqueue_at(g->black_queue, 2)->r, 2);
 
-  cr_assert_eq(g->black_queue->head->p.c, 1);
-  cr_assert_eq(g->black_queue->head->p.r, 2);
-  g->black_queue->head = g->black_queue->head->next;
+  cr_assert_eq(posqueue_at(g->white_queue, 1)->c, 0);
+  cr_assert_eq(posqueue_at(g->white_queue, 1)->r, 3);
 
-  cr_assert_eq(g->white_queue->head->p.c, 0);
-  cr_assert_eq(g->white_queue->head->p.r, 3);
-  g->white_queue->head = g->white_queue->head->next;
+  cr_assert_eq(posqueue_at(g->black_queue, 3)->c, 0);
+  cr_assert_eq(posqueue_at(g->black_queue, 3)->r, 4);
 
-  cr_assert_eq(g->black_queue->head->p.c, 0);
-  cr_assert_eq(g->black_queue->head->p.r, 4);
-  g->black_queue->head = g->black_queue->head->next;
+  cr_assert_eq(posqueue_at(g->white_queue, 2)->c, 1);
+  cr_assert_eq(posqueue_at(g->white_queue, 2)->r, 3);
 
-  cr_assert_eq(g->white_queue->head->p.c, 1);
-  cr_assert_eq(g->white_queue->head->p.r, 3);
-  g->white_queue->head = g->white_queue->head->next;
+  cr_assert_eq(posqueue_at(g->white_queue, 3)->c, 1);
+  cr_assert_eq(posqueue_at(g->white_queue, 3)->r, 4);
 
-  cr_assert_eq(g->white_queue->head->p.c, 1);
-  cr_assert_eq(g->white_queue->head->p.r, 4);
-  g->white_queue->head = g->white_queue->head->next;
+  game_free(g);
+}
 
+Test(offset, both_in_one_column_upper_removed) {
+  game* g = new_game(5, 2, 5, MATRIX);
+  drop_piece(g, 0);
+  drop_piece(g, 0);
+  drop_piece(g, 1);
+  drop_piece(g, 0);
+  cr_assert(offset(g));
+  cr_assert_eq(board_get(g->b, make_pos(4, 0)), WHITE);
+  cr_assert_eq(board_get(g->b, make_pos(3, 0)), EMPTY);
+  cr_assert_eq(board_get(g->b, make_pos(2, 0)), EMPTY);
+  cr_assert_eq(posqueue_at(g->white_queue, 0)->r, 4);
+  cr_assert_eq(posqueue_at(g->white_queue, 0)->c, 0);
+  cr_assert_eq(g->col_height[0], 1);
+  cr_assert(drop_piece(g, 0));
+  cr_assert_eq(board_get(g->b, make_pos(3, 0)), WHITE);
   game_free(g);
 }
 
@@ -662,6 +1021,32 @@ Test(game_outcome, full_board_draw) {
   game_free(g);
 }
 
+Test(game_outcome, run_broken_by_offset) {
+  game* g = new_game(3, 4, 4, MATRIX);
+  drop_piece(g, 0);
+  drop_piece(g, 3);
+  drop_piece(g, 1);
+  drop_piece(g, 3);
+  drop_piece(g, 2);
+  cr_assert_eq(game_outcome(g), BLACK_WIN);
+  cr_assert(offset(g));
+  cr_assert_eq(game_outcome(g), IN_PROGRESS);
+  game_free(g);
+}
+
+Test(game_outcome, run_made_by_disarray) {
+  game* g = new_game(3, 3, 4, MATRIX);
+  drop_piece(g, 1);
+  drop_piece(g, 0);
+  drop_piece(g, 0);
+  drop_piece(g, 2);
+  drop_piece(g, 2);
+  cr_assert_eq(game_outcome(g), IN_PROGRESS);
+  disarray(g);
+  cr_assert_eq(game_outcome(g), BLACK_WIN);
+  game_free(g);
+}
+
 
 // Bits test
 Test(board_new, small_board_bits) {
@@ -767,29 +1152,23 @@ Test(disarray, pieces_in_multiple_columns_bits) {
   cr_assert_eq(board_get(g->b, make_pos(4, 3)), WHITE);
   cr_assert_eq(board_get(g->b, make_pos(3, 3)), BLACK);
   
-  cr_assert_eq(g->black_queue->head->p.c, 0);
-  cr_assert_eq(g->black_queue->head->p.r, 4);
-  g->black_queue->head = g->black_queue->head->next;
+  cr_assert_eq(posqueue_at(g->black_queue, 0)->c, 0);
+  cr_assert_eq(posqueue_at(g->black_queue, 0)->r, 4);
   
-  cr_assert_eq(g->black_queue->head->p.c, 1);
-  cr_assert_eq(g->black_queue->head->p.r, 4);
-  g->black_queue->head = g->black_queue->head->next;
+  cr_assert_eq(posqueue_at(g->black_queue, 1)->c, 1);
+  cr_assert_eq(posqueue_at(g->black_queue, 1)->r, 4);
 
-  cr_assert_eq(g->white_queue->head->p.c, 1);
-  cr_assert_eq(g->white_queue->head->p.r, 3);
-  g->white_queue->head = g->white_queue->head->next;
+  cr_assert_eq(posqueue_at(g->white_queue, 0)->c, 1);
+  cr_assert_eq(posqueue_at(g->white_queue, 0)->r, 3);
 
-  cr_assert_eq(g->black_queue->head->p.c, 3);
-  cr_assert_eq(g->black_queue->head->p.r, 3);
-  g->black_queue->head = g->black_queue->head->next;
+  cr_assert_eq(posqueue_at(g->black_queue, 2)->c, 3);
+  cr_assert_eq(posqueue_at(g->black_queue, 2)->r, 3);
 
-  cr_assert_eq(g->white_queue->head->p.c, 2);
-  cr_assert_eq(g->white_queue->head->p.r, 4);
-  g->white_queue->head = g->white_queue->head->next;
+  cr_assert_eq(posqueue_at(g->white_queue, 1)->c, 2);
+  cr_assert_eq(posqueue_at(g->white_queue, 1)->r, 4);
 
-  cr_assert_eq(g->white_queue->head->p.c, 3);
-  cr_assert_eq(g->white_queue->head->p.r, 4);
-  g->white_queue->head = g->white_queue->head->next;
+  cr_assert_eq(posqueue_at(g->white_queue, 2)->c, 3);
+  cr_assert_eq(posqueue_at(g->white_queue, 2)->r, 4);
 
   game_free(g);
 }
@@ -858,39 +1237,926 @@ Test(offset, both_one_col_bits) {
   cr_assert_eq(board_get(g->b, make_pos(1, 2)), EMPTY);
   cr_assert_eq(board_get(g->b, make_pos(0, 2)), EMPTY);
   
-  cr_assert_eq(g->black_queue->head->p.c, 0);
-  cr_assert_eq(g->black_queue->head->p.r, 2);
-  g->black_queue->head = g->black_queue->head->next;
+  cr_assert_eq(posqueue_at(g->black_queue, 0)->c, 0);
+  cr_assert_eq(posqueue_at(g->black_queue, 0)->r, 2);
   
-  cr_assert_eq(g->black_queue->head->p.c, 1);
-  cr_assert_eq(g->black_queue->head->p.r, 1);
-  g->black_queue->head = g->black_queue->head->next;
+  cr_assert_eq(posqueue_at(g->black_queue, 1)->c, 1);
+  cr_assert_eq(posqueue_at(g->black_queue, 1)->r, 1);
 
-  cr_assert_eq(g->white_queue->head->p.c, 2);
-  cr_assert_eq(g->white_queue->head->p.r, 4);
-  g->white_queue->head = g->white_queue->head->next;
+  cr_assert_eq(posqueue_at(g->white_queue, 0)->c, 2);
+  cr_assert_eq(posqueue_at(g->white_queue, 0)->r, 4);
 
-  cr_assert_eq(g->black_queue->head->p.c, 1);
-  cr_assert_eq(g->black_queue->head->p.r, 2);
-  g->black_queue->head = g->black_queue->head->next;
+  cr_assert_eq(posqueue_at(g->black_queue, 2)->c, 1);
+  cr_assert_eq(posqueue_at(g->black_queue, 2)->r, 2);
 
-  cr_assert_eq(g->white_queue->head->p.c, 0);
-  cr_assert_eq(g->white_queue->head->p.r, 3);
-  g->white_queue->head = g->white_queue->head->next;
+  cr_assert_eq(posqueue_at(g->white_queue, 1)->c, 0);
+  cr_assert_eq(posqueue_at(g->white_queue, 1)->r, 3);
 
-  cr_assert_eq(g->black_queue->head->p.c, 0);
-  cr_assert_eq(g->black_queue->head->p.r, 4);
-  g->black_queue->head = g->black_queue->head->next;
+  cr_assert_eq(posqueue_at(g->black_queue, 3)->c, 0);
+  cr_assert_eq(posqueue_at(g->black_queue, 3)->r, 4);
 
-  cr_assert_eq(g->white_queue->head->p.c, 1);
-  cr_assert_eq(g->white_queue->head->p.r, 3);
-  g->white_queue->head = g->white_queue->head->next;
+  cr_assert_eq(posqueue_at(g->white_queue, 2)->c, 1);
+  cr_assert_eq(posqueue_at(g->white_queue, 2)->r, 3);
 
-  cr_assert_eq(g->white_queue->head->p.c, 1);
-  cr_assert_eq(g->white_queue->head->p.r, 4);
-  g->white_queue->head = g->white_queue->head->next;
+  cr_assert_eq(posqueue_at(g->white_queue, 3)->c, 1);
+  cr_assert_eq(posqueue_at(g->white_queue, 3)->r, 4);
 
   game_free(g);
 }
 
 
+
+// Bitboard tests
+Test(board_new, small_board_bitboard) {
+  board* b = board_new(5, 5, BITBOARD);
+  cr_assert_not_null(b);
+  cr_assert_eq(b->width, 5);
+  cr_assert_eq(b->height, 5);
+  cr_assert_eq(b->type, BITBOARD);
+  for (unsigned int r = 0; r < 5; r++) {
+    for (unsigned int c = 0; c < 5; c++) {
+      cr_assert_eq(board_get(b, make_pos(r, c)), EMPTY);
+    }
+  }
+  board_free(b);
+}
+
+Test(board_get, random_position_bitboard) {
+  board* b = board_new(7, 6, BITBOARD);
+  pos p = make_pos(3, 6);
+  cr_assert_eq(board_get(b, p), EMPTY);
+  // column 6 starts at bit 6 * 7, and row 3 is two rows above the bottom
+  b->u.planes[0] |= (uint64_t) 1 << (6 * 7 + 2);
+  cr_assert_eq(board_get(b, p), BLACK);
+  board_free(b);
+}
+
+Test(board_set, position_bitboard) {
+  board* b = board_new(5, 5, BITBOARD);
+  pos p = make_pos(1, 1);
+  board_set(b, p, BLACK);
+  cr_assert_eq(board_get(b, p), BLACK);
+  board_set(b, p, WHITE);
+  cr_assert_eq(board_get(b, p), WHITE);
+  board_set(b, p, EMPTY);
+  cr_assert_eq(board_get(b, p), EMPTY);
+  board_free(b);
+}
+
+Test(board_set, multi_word_bitboard) {
+  board* b = board_new(62, 40, BITBOARD);
+  board_set(b, make_pos(0, 61), WHITE);
+  board_set(b, make_pos(39, 0), BLACK);
+  board_set(b, make_pos(20, 30), BLACK);
+  cr_assert_eq(board_get(b, make_pos(0, 61)), WHITE);
+  cr_assert_eq(board_get(b, make_pos(39, 0)), BLACK);
+  cr_assert_eq(board_get(b, make_pos(20, 30)), BLACK);
+  cr_assert_eq(board_get(b, make_pos(21, 30)), EMPTY);
+  board_free(b);
+}
+
+Test(game_outcome, horizontal_run_bitboard) {
+  game* g = new_game(4, 5, 5, BITBOARD);
+  drop_piece(g, 0);
+  drop_piece(g, 4);
+  drop_piece(g, 1);
+  drop_piece(g, 4);
+  drop_piece(g, 2);
+  drop_piece(g, 4);
+  cr_assert_eq(game_outcome(g), IN_PROGRESS);
+  drop_piece(g, 3);
+  cr_assert_eq(game_outcome(g), BLACK_WIN);
+  game_free(g);
+}
+
+Test(game_outcome, vertical_run_bitboard) {
+  game* g = new_game(4, 5, 5, BITBOARD);
+  drop_piece(g, 0);
+  drop_piece(g, 1);
+  drop_piece(g, 0);
+  drop_piece(g, 1);
+  drop_piece(g, 0);
+  drop_piece(g, 1);
+  drop_piece(g, 2);
+  drop_piece(g, 1);
+  cr_assert_eq(game_outcome(g), WHITE_WIN);
+  game_free(g);
+}
+
+Test(game_outcome, diagonal_runs_bitboard) {
+  game* g = new_game(3, 3, 3, BITBOARD);
+  drop_piece(g, 1);
+  drop_piece(g, 0);
+  drop_piece(g, 2);
+  drop_piece(g, 1);
+  drop_piece(g, 2);
+  drop_piece(g, 2);
+  cr_assert_eq(game_outcome(g), WHITE_WIN);
+  game_free(g);
+
+  g = new_game(3, 3, 3, BITBOARD);
+  drop_piece(g, 2);
+  drop_piece(g, 1);
+  drop_piece(g, 1);
+  drop_piece(g, 0);
+  drop_piece(g, 2);
+  drop_piece(g, 0);
+  drop_piece(g, 0);
+  cr_assert_eq(game_outcome(g), BLACK_WIN);
+  game_free(g);
+}
+
+Test(game_outcome, no_wrap_between_columns_bitboard) {
+  // a vertical stack at the top of one column and one at the bottom of the
+  // next are adjacent bits only without the padding row
+  game* g = new_game(3, 2, 3, BITBOARD);
+  board_set(g->b, make_pos(0, 0), BLACK);
+  board_set(g->b, make_pos(1, 0), BLACK);
+  board_set(g->b, make_pos(2, 1), BLACK);
+  board_set(g->b, make_pos(1, 1), BLACK);
+  game_invalidate(g);
+  cr_assert_eq(game_outcome(g), IN_PROGRESS);
+  game_free(g);
+}
+
+Test(game_outcome, full_board_draw_bitboard) {
+  game* g = new_game(3, 3, 3, BITBOARD);
+  drop_piece(g, 1);
+  drop_piece(g, 0);
+  drop_piece(g, 0);
+  drop_piece(g, 2);
+  drop_piece(g, 2);
+  drop_piece(g, 1);
+  drop_piece(g, 0);
+  drop_piece(g, 1);
+  drop_piece(g, 2);
+  cr_assert_eq(game_outcome(g), DRAW);
+  game_free(g);
+}
+
+Test(game_outcome, multi_word_runs_bitboard) {
+  game* g = new_game(5, 62, 20, BITBOARD);
+  for (unsigned int c = 40; c < 45; c++) {
+    board_set(g->b, make_pos(19, c), WHITE);
+  }
+  game_invalidate(g);
+  cr_assert_eq(game_outcome(g), WHITE_WIN);
+  board_set(g->b, make_pos(19, 42), BLACK);
+  game_invalidate(g);
+  cr_assert_eq(game_outcome(g), IN_PROGRESS);
+  for (unsigned int i = 0; i < 5; i++) {
+    board_set(g->b, make_pos(19 - i, 50 + i), BLACK);
+  }
+  game_invalidate(g);
+  cr_assert_eq(game_outcome(g), BLACK_WIN);
+  game_free(g);
+}
+
+// make and unmake tests
+/* Checks that two games hold the same board, queues, heights and turn. */
+void assert_same_game(game* g1, game* g2) {
+  cr_assert_eq(g1->player, g2->player);
+  for (unsigned int r = 0; r < g1->b->height; r++) {
+    for (unsigned int c = 0; c < g1->b->width; c++) {
+      cr_assert_eq(board_get(g1->b, make_pos(r, c)), 
+                   board_get(g2->b, make_pos(r, c)));
+    }
+  }
+  for (unsigned int c = 0; c < g1->b->width; c++) {
+    cr_assert_eq(g1->col_height[c], g2->col_height[c]);
+  }
+  posqueue* qs1[2] = {g1->black_queue, g1->white_queue};
+  posqueue* qs2[2] = {g2->black_queue, g2->white_queue};
+  for (unsigned int k = 0; k < 2; k++) {
+    cr_assert_eq(qs1[k]->len, qs2[k]->len);
+    for (unsigned int i = 0; i < qs1[k]->len; i++) {
+      cr_assert_eq(posqueue_at(qs1[k], i)->r, posqueue_at(qs2[k], i)->r);
+      cr_assert_eq(posqueue_at(qs1[k], i)->c, posqueue_at(qs2[k], i)->c);
+    }
+  }
+}
+
+Test(game_make_move, illegal_moves_not_recorded) {
+  game* g = new_game(3, 3, 3, MATRIX);
+  move off = {MOVE_OFFSET, 0};
+  move drop = {MOVE_DROP, 3};
+  cr_assert_not(game_make_move(g, off));
+  cr_assert_not(game_make_move(g, drop));
+  cr_assert_eq(g->undo_len, 0);
+  cr_assert_not(game_unmake_move(g));
+  game_free(g);
+}
+
+Test(game_unmake_move, offset_in_one_column) {
+  game* g = new_game(5, 2, 5, BITS);
+  game* ref = new_game(5, 2, 5, BITS);
+  unsigned int cols[4] = {0, 0, 1, 0};
+  for (unsigned int i = 0; i < 4; i++) {
+    move m = {MOVE_DROP, cols[i]};
+    cr_assert(game_make_move(g, m));
+    drop_piece(ref, cols[i]);
+  }
+  move off = {MOVE_OFFSET, 0};
+  cr_assert(game_make_move(g, off));
+  cr_assert_eq(board_get(g->b, make_pos(3, 0)), EMPTY);
+  cr_assert(game_unmake_move(g));
+  assert_same_game(g, ref);
+  game_free(g);
+  game_free(ref);
+}
+
+Test(game_unmake_move, restores_every_position) {
+  enum type types[3] = {MATRIX, BITS, BITBOARD};
+  for (unsigned int t = 0; t < 3; t++) {
+    game* g = new_game(4, 6, 5, types[t]);
+    game* replay[41];
+    unsigned int seed = 12345, played = 0;
+    move moves[40];
+    replay[0] = new_game(4, 6, 5, types[t]);
+    while (played < 40) {
+      seed = seed * 1103515245 + 12345;
+      unsigned int k = (seed >> 16) % 10;
+      move m = {k == 0 ? MOVE_DISARRAY : k < 3 ? MOVE_OFFSET : MOVE_DROP, 
+                (seed >> 8) % 6};
+      if (!game_make_move(g, m)) {
+        continue;
+      }
+      moves[played++] = m;
+      game_outcome(g);
+    }
+    // rebuild every intermediate position from scratch to compare against
+    for (unsigned int i = 1; i <= 40; i++) {
+      replay[i] = new_game(4, 6, 5, types[t]);
+      for (unsigned int j = 0; j < i; j++) {
+        game_make_move(replay[i], moves[j]);
+      }
+    }
+    for (unsigned int i = 40; i > 0; i--) {
+      assert_same_game(g, replay[i]);
+      cr_assert_eq(game_outcome(g), game_outcome(replay[i]));
+      cr_assert(game_unmake_move(g));
+    }
+    assert_same_game(g, replay[0]);
+    for (unsigned int i = 0; i <= 40; i++) {
+      game_free(replay[i]);
+    }
+    game_free(g);
+  }
+}
+
+// key tests
+Test(game_key, same_state_same_key) {
+  game* g1 = new_game(4, 5, 5, MATRIX);
+  game* g2 = new_game(4, 5, 5, BITS);
+  drop_piece(g1, 0);
+  drop_piece(g1, 1);
+  drop_piece(g2, 0);
+  drop_piece(g2, 1);
+  // with one piece in each column a disarray changes nothing but the turn
+  disarray(g2);
+  disarray(g2);
+  cr_assert_eq(game_key(g1), game_key(g2));
+  game_free(g1);
+  game_free(g2);
+}
+
+Test(game_key, queue_order_changes_key) {
+  game* g1 = new_game(4, 5, 5, MATRIX);
+  game* g2 = new_game(4, 5, 5, MATRIX);
+  drop_piece(g1, 0);
+  drop_piece(g1, 4);
+  drop_piece(g1, 2);
+  drop_piece(g2, 2);
+  drop_piece(g2, 4);
+  drop_piece(g2, 0);
+  cr_assert_eq(g1->b->key, g2->b->key);
+  cr_assert_neq(game_key(g1), game_key(g2));
+  game_free(g1);
+  game_free(g2);
+}
+
+Test(game_key, turn_changes_key) {
+  game* g = new_game(4, 5, 5, BITBOARD);
+  uint64_t start = game_key(g);
+  disarray(g);
+  cr_assert_neq(game_key(g), start);
+  disarray(g);
+  cr_assert_eq(game_key(g), start);
+  game_free(g);
+}
+
+Test(game_key, restored_by_unmake) {
+  game* g = new_game(3, 4, 4, BITS);
+  uint64_t keys[9];
+  move moves[8] = {{MOVE_DROP, 0}, {MOVE_DROP, 0}, {MOVE_DROP, 1},
+                   {MOVE_DISARRAY, 0}, {MOVE_DROP, 0}, {MOVE_OFFSET, 0},
+                   {MOVE_DROP, 3}, {MOVE_DROP, 2}};
+  keys[0] = game_key(g);
+  for (unsigned int i = 0; i < 8; i++) {
+    cr_assert(game_make_move(g, moves[i]));
+    keys[i + 1] = game_key(g);
+  }
+  for (unsigned int i = 8; i > 0; i--) {
+    cr_assert_eq(game_key(g), keys[i]);
+    game_unmake_move(g);
+  }
+  cr_assert_eq(game_key(g), keys[0]);
+  game_free(g);
+}
+
+Test(legal_moves, offset_needs_both_players) {
+  game* g = new_game(3, 3, 2, MATRIX);
+  move moves[5];
+  cr_assert_eq(legal_moves(g, moves), 4);
+  cr_assert_eq(moves[3].type, MOVE_DISARRAY);
+  drop_piece(g, 1);
+  cr_assert_eq(legal_moves(g, moves), 4);
+  drop_piece(g, 1);
+  cr_assert_eq(legal_moves(g, moves), 4);
+  cr_assert_eq(moves[0].column, 0);
+  cr_assert_eq(moves[1].column, 2);
+  cr_assert_eq(moves[2].type, MOVE_OFFSET);
+  cr_assert_eq(moves[3].type, MOVE_DISARRAY);
+  game_free(g);
+}
+
+Test(engine_search, takes_winning_drop) {
+  game* g = new_game(4, 7, 6, BITBOARD);
+  unsigned int cols[6] = {0, 0, 1, 1, 2, 5};
+  for (unsigned int i = 0; i < 6; i++) {
+    drop_piece(g, cols[i]);
+  }
+  engine* e = engine_new(16);
+  engine_stats stats;
+  move m = engine_search(e, g, 4, 0, &stats);
+  cr_assert_eq(m.type, MOVE_DROP);
+  cr_assert_eq(m.column, 3);
+  cr_assert_eq(stats.score, ENGINE_WIN - 1);
+  cr_assert_gt(stats.nodes, 0);
+  engine_free(e);
+  game_free(g);
+}
+
+Test(engine_search, stops_immediate_loss) {
+  game* g = new_game(4, 7, 6, MATRIX);
+  unsigned int cols[5] = {0, 6, 1, 6, 2};
+  for (unsigned int i = 0; i < 5; i++) {
+    drop_piece(g, cols[i]);
+  }
+  engine* e = engine_new(16);
+  game_make_move(g, engine_search(e, g, 3, 0, NULL));
+  move replies[9];
+  unsigned int n = legal_moves(g, replies);
+  for (unsigned int i = 0; i < n; i++) {
+    game_make_move(g, replies[i]);
+    cr_assert_neq(game_outcome(g), BLACK_WIN);
+    game_unmake_move(g);
+  }
+  engine_free(e);
+  game_free(g);
+}
+
+Test(engine_search, leaves_game_unchanged) {
+  game* g = new_game(3, 4, 4, BITS);
+  drop_piece(g, 1);
+  drop_piece(g, 2);
+  drop_piece(g, 1);
+  uint64_t key = game_key(g);
+  engine* e = engine_new(12);
+  engine_search(e, g, 5, 0, NULL);
+  cr_assert_eq(game_key(g), key);
+  cr_assert_eq(g->undo_len, 0);
+  cr_assert_eq(g->player, WHITES_TURN);
+  cr_assert_eq(g->black_queue->len, 2);
+  engine_free(e);
+  game_free(g);
+}
+
+/* Sends standard output into a pipe until capture_end, so that what is
+   printed can be checked.
+
+   @param int* where the two ends of the pipe are stored
+   @return int a copy of the standard output that capture_end restores
+   */
+int capture_begin(int fds[2]) {
+  cr_assert_eq(pipe(fds), 0);
+  fflush(stdout);
+  int saved = dup(STDOUT_FILENO);
+  dup2(fds[1], STDOUT_FILENO);
+  return saved;
+}
+
+/* Restores standard output after capture_begin and reads what was printed.
+
+   @param int* the two ends of the pipe
+   @param int the copy of the standard output
+   @param char* where the output is stored, ended by a null character
+   @param size_t the size of the output buffer
+   */
+void capture_end(int fds[2], int saved, char* out, size_t size) {
+  fflush(stdout);
+  dup2(saved, STDOUT_FILENO);
+  close(saved);
+  close(fds[1]);
+  size_t len = 0;
+  ssize_t n;
+  while (len + 1 < size &&
+         (n = read(fds[0], out + len, size - 1 - len)) > 0) {
+    len += (size_t) n;
+  }
+  out[len] = '\0';
+  close(fds[0]);
+}
+
+Test(game_show, lazy_game_shown_in_order) {
+  game* g = new_game(3, 3, 3, MATRIX);
+  game_set_lazy(g, true);
+  drop_piece(g, 0);
+  drop_piece(g, 0);
+  disarray(g);
+  cr_assert_eq(g->flipped_len, 1);
+  int fds[2];
+  int saved = capture_begin(fds);
+  game_show(g);
+  char out[64];
+  capture_end(fds, saved, out, sizeof(out));
+  cr_assert_str_eq(out, "  012\n0 ...\n1 *..\n2 o..\n");
+  cr_assert(g->lazy);
+  cr_assert_eq(g->flipped_len, 0);
+  game_free(g);
+}
+
+Test(engine_search, lazy_game_searched_in_full) {
+  game* lazy = new_game(3, 4, 4, BITS);
+  game* full = new_game(3, 4, 4, BITS);
+  game_set_lazy(lazy, true);
+  unsigned int cols[4] = {1, 2, 1, 1};
+  for (unsigned int i = 0; i < 4; i++) {
+    drop_piece(lazy, cols[i]);
+    drop_piece(full, cols[i]);
+  }
+  disarray(lazy);
+  disarray(full);
+  cr_assert_gt(lazy->flipped_len, 0);
+  engine* e = engine_new(12);
+  engine_stats lazy_stats, full_stats;
+  move m = engine_search(e, lazy, 4, 0, &lazy_stats);
+  cr_assert(lazy->lazy);
+  cr_assert_eq(lazy->flipped_len, 0);
+  cr_assert_eq(game_key(lazy), game_key(full));
+  engine_clear(e);
+  move n = engine_search(e, full, 4, 0, &full_stats);
+  cr_assert_eq(m.type, n.type);
+  cr_assert_eq(m.column, n.column);
+  cr_assert_eq(lazy_stats.nodes, full_stats.nodes);
+  engine_free(e);
+  game_free(full);
+  game_free(lazy);
+}
+
+Test(offset, queue_index_follows_pieces) {
+  game* g = new_game(6, 5, 6, BITS);
+  unsigned int cols[14] = {0, 1, 1, 2, 2, 2, 3, 4, 4, 0, 1, 2, 3, 3};
+  for (unsigned int i = 0; i < 14; i++) {
+    drop_piece(g, cols[i]);
+    if (i % 5 == 4) {
+      offset(g);
+    } else if (i % 4 == 3) {
+      disarray(g);
+    }
+  }
+  posqueue* queues[2] = {g->black_queue, g->white_queue};
+  for (unsigned int k = 0; k < 2; k++) {
+    for (unsigned int i = 0; i < queues[k]->len; i++) {
+      pos p = *posqueue_at(queues[k], i);
+      cr_assert_eq(board_get(g->b, p), k == 0 ? BLACK : WHITE);
+      cr_assert_eq(g->entry_slot[p.r * 5 + p.c], posqueue_slot(queues[k], i));
+    }
+  }
+  game_free(g);
+}
+
+Test(disarray, lazy_matches_full_flip) {
+  game* lazy = new_game(4, 4, 5, MATRIX);
+  game* full = new_game(4, 4, 5, MATRIX);
+  game_set_lazy(lazy, true);
+  unsigned int cols[7] = {0, 0, 0, 1, 2, 2, 3};
+  for (unsigned int i = 0; i < 7; i++) {
+    drop_piece(lazy, cols[i]);
+    drop_piece(full, cols[i]);
+  }
+  disarray(lazy);
+  disarray(full);
+  // only the columns holding two or more pieces are marked
+  cr_assert(lazy->flipped[0]);
+  cr_assert_not(lazy->flipped[1]);
+  cr_assert(lazy->flipped[2]);
+  cr_assert_eq(board_get(lazy->b, make_pos(4, 2)), BLACK);
+  cr_assert_eq(game_cell(lazy, make_pos(4, 2)), WHITE);
+  for (unsigned int r = 0; r < 5; r++) {
+    for (unsigned int c = 0; c < 4; c++) {
+      cr_assert_eq(game_cell(lazy, make_pos(r, c)),
+                   board_get(full->b, make_pos(r, c)));
+    }
+  }
+  // the drop puts the column back in order before it lands
+  drop_piece(lazy, 0);
+  drop_piece(full, 0);
+  cr_assert_not(lazy->flipped[0]);
+  offset(lazy);
+  offset(full);
+  cr_assert_eq(game_outcome(lazy), game_outcome(full));
+  game_sync(lazy);
+  cr_assert_eq(lazy->flipped_len, 0);
+  assert_same_game(lazy, full);
+  cr_assert_eq(game_key(lazy), game_key(full));
+  game_free(lazy);
+  game_free(full);
+}
+
+Test(game_unmake_move, lazy_disarray_restores_key) {
+  game* g = new_game(3, 3, 4, COLUMNS);
+  game_set_lazy(g, true);
+  unsigned int cols[5] = {1, 1, 2, 1, 2};
+  for (unsigned int i = 0; i < 5; i++) {
+    drop_piece(g, cols[i]);
+  }
+  uint64_t before = game_key(g);
+  move dis = {MOVE_DISARRAY, 0};
+  move drop = {MOVE_DROP, 1};
+  move off = {MOVE_OFFSET, 0};
+  cr_assert(game_make_move(g, dis));
+  uint64_t flipped = game_key(g);
+  cr_assert(game_make_move(g, drop));
+  cr_assert(game_make_move(g, off));
+  cr_assert(game_unmake_move(g));
+  cr_assert(game_unmake_move(g));
+  cr_assert_eq(game_key(g), flipped);
+  cr_assert(g->flipped[1]);
+  cr_assert(game_unmake_move(g));
+  cr_assert_eq(game_key(g), before);
+  cr_assert_eq(g->flipped_len, 0);
+  game_free(g);
+}
+
+Test(game_reset, matches_new_game) {
+  game* g = new_game(4, 5, 4, BITBOARD);
+  game* fresh = new_game(4, 5, 4, BITBOARD);
+  unsigned int cols[6] = {0, 1, 1, 2, 4, 4};
+  for (unsigned int i = 0; i < 6; i++) {
+    move m = {MOVE_DROP, cols[i]};
+    game_make_move(g, m);
+  }
+  move dis = {MOVE_DISARRAY, 0};
+  game_make_move(g, dis);
+  game_reset(g);
+  assert_same_game(g, fresh);
+  cr_assert_eq(game_key(g), game_key(fresh));
+  cr_assert_eq(g->undo_len, 0);
+  cr_assert_eq(game_outcome(g), IN_PROGRESS);
+  drop_piece(g, 3);
+  cr_assert_eq(g->black_queue->len, 1);
+  game_free(g);
+  game_free(fresh);
+}
+
+Test(mcts_search, takes_winning_drop) {
+  game* g = new_game(4, 7, 6, BITBOARD);
+  unsigned int cols[6] = {0, 0, 1, 1, 2, 5};
+  for (unsigned int i = 0; i < 6; i++) {
+    drop_piece(g, cols[i]);
+  }
+  uint64_t key = game_key(g);
+  mcts* m = mcts_new(2, 7);
+  mcts_stats stats;
+  move best = mcts_search(m, g, 4000, 0, &stats);
+  cr_assert_eq(best.type, MOVE_DROP);
+  cr_assert_eq(best.column, 3);
+  cr_assert_eq(stats.playouts, 4000);
+  cr_assert_gt(stats.value, 0.9);
+  // the search only plays in copies of the game
+  cr_assert_eq(game_key(g), key);
+  cr_assert_eq(g->undo_len, 0);
+  cr_assert_eq(g->black_queue->len, 3);
+  mcts_free(m);
+  game_free(g);
+}
+
+Test(game_clone, plays_on_its_own) {
+  game* g = new_game(4, 5, 5, COLUMNS);
+  unsigned int cols[7] = {0, 0, 1, 2, 2, 2, 4};
+  for (unsigned int i = 0; i < 7; i++) {
+    drop_piece(g, cols[i]);
+  }
+  offset(g);
+  disarray(g);
+  game* copy = game_clone(g);
+  assert_same_game(copy, g);
+  cr_assert_eq(game_key(copy), game_key(g));
+  move off = {MOVE_OFFSET, 0};
+  cr_assert(game_make_move(copy, off));
+  cr_assert(game_unmake_move(copy));
+  assert_same_game(copy, g);
+  drop_piece(copy, 3);
+  cr_assert_eq(board_get(g->b, make_pos(4, 3)), EMPTY);
+  game_free(copy);
+  game_free(g);
+}
+
+Test(game_copy_into, restores_snapshot) {
+  game* g = new_game(4, 6, 5, MATRIX);
+  unsigned int cols[8] = {0, 1, 1, 2, 3, 3, 3, 5};
+  for (unsigned int i = 0; i < 8; i++) {
+    drop_piece(g, cols[i]);
+  }
+  game* snapshot = game_clone(g);
+  for (unsigned int i = 0; i < 5; i++) {
+    move m = {i % 2 ? MOVE_OFFSET : MOVE_DROP, i};
+    game_make_move(g, m);
+  }
+  game_copy_into(g, snapshot);
+  assert_same_game(g, snapshot);
+  cr_assert_eq(game_key(g), game_key(snapshot));
+  cr_assert_eq(g->undo_len, 0);
+  cr_assert_eq(game_outcome(g), game_outcome(snapshot));
+  // the copy has its own block, so playing in it leaves the snapshot alone
+  drop_piece(g, 4);
+  cr_assert_eq(board_get(snapshot->b, make_pos(4, 4)), EMPTY);
+  cr_assert_eq(board_get(g->b, make_pos(4, 4)), BLACK);
+  game_free(snapshot);
+  game_free(g);
+}
+
+Test(new_game_in, carves_from_arena) {
+  arena* a = arena_new(1 << 16);
+  game* g1 = new_game_in(a, 4, 7, 6, MATRIX);
+  game* g2 = new_game_in(a, 4, 7, 6, BITBOARD);
+  cr_assert((char*) g1 >= a->base && (char*) g1 < a->base + a->size);
+  cr_assert((char*) g2 >= (char*) g1 + g1->size);
+  cr_assert_eq(((uintptr_t) g1->b->u.matrix) % 64, 0);
+  // enough moves to grow the undo stack out of the arena
+  for (unsigned int i = 0; i < 100; i++) {
+    move m = {i % 3 == 2 ? MOVE_DISARRAY : MOVE_DROP, i % 7};
+    game_make_move(g1, m);
+    game_make_move(g2, m);
+  }
+  cr_assert_eq(game_outcome(g1), game_outcome(g2));
+  while (game_unmake_move(g1)) {
+  }
+  cr_assert_eq(g1->black_queue->len, 0);
+  cr_assert_eq(game_key(g1), 0);
+  game_free(g1);
+  arena_reset(a);
+  cr_assert_eq(a->used, 0);
+  arena_free(a);
+}
+
+Test(game_pool, recycles_games) {
+  game_pool* p = game_pool_new(NULL, 3, 4, 4, COLUMNS);
+  game* g = game_pool_get(p);
+  drop_piece(g, 1);
+  drop_piece(g, 1);
+  game_set_lazy(g, true);
+  disarray(g);
+  game_pool_put(p, g);
+  cr_assert_eq(p->len, 1);
+  game* again = game_pool_get(p);
+  cr_assert_eq(again, g);
+  cr_assert_eq(p->len, 0);
+  cr_assert_not(again->lazy);
+  cr_assert_eq(again->player, BLACKS_TURN);
+  cr_assert_eq(again->col_height[1], 0);
+  cr_assert_eq(game_key(again), 0);
+  game* other = game_pool_get(p);
+  cr_assert_neq(other, again);
+  game_pool_put(p, again);
+  game_pool_put(p, other);
+  game_pool_free(p);
+}
+
+Test(game_set_position, matches_played_game) {
+  game* played = new_game(3, 4, 4, BITS);
+  drop_piece(played, 0);
+  drop_piece(played, 1);
+  drop_piece(played, 0);
+  pos black[2] = {make_pos(3, 0), make_pos(2, 0)};
+  pos white[1] = {make_pos(3, 1)};
+  game* g = new_game(3, 4, 4, BITS);
+  drop_piece(g, 3);
+  game_set_position(g, black, 2, white, 1, WHITES_TURN);
+  cr_assert_eq(game_key(g), game_key(played));
+  cr_assert_eq(g->col_height[0], 2);
+  cr_assert_eq(g->col_height[3], 0);
+  cr_assert(offset(g));
+  cr_assert(offset(played));
+  cr_assert_eq(game_key(g), game_key(played));
+  game_free(g);
+  game_free(played);
+}
+
+Test(solvedb, engine_plays_from_database) {
+  // black to move wins at once with a drop into column 2; the values of
+  // the other moves are made up, but are worse for black
+  game* g = new_game(3, 4, 4, MATRIX);
+  drop_piece(g, 0);
+  drop_piece(g, 0);
+  drop_piece(g, 1);
+  drop_piece(g, 1);
+  uint64_t keys[7];
+  solved values[7];
+  keys[0] = game_key(g);
+  values[0] = (solved) {SOLVED_WIN, 1};
+  move moves[6];
+  unsigned int n = legal_moves(g, moves);
+  for (unsigned int i = 0; i < n; i++) {
+    game_make_move(g, moves[i]);
+    keys[i + 1] = game_key(g);
+    bool wins = moves[i].type == MOVE_DROP && moves[i].column == 2;
+    values[i + 1] = wins ? (solved) {SOLVED_LOSS, 0}
+                         : (solved) {SOLVED_DRAW, 0};
+    game_unmake_move(g);
+  }
+  solvedb_write("test_solvedb.db", 3, 4, 4, keys, values, n + 1);
+  solvedb* db = solvedb_open("test_solvedb.db");
+  remove("test_solvedb.db");
+
+  solved value;
+  move best;
+  cr_assert(solvedb_best_move(db, g, &best, &value));
+  cr_assert_eq(best.type, MOVE_DROP);
+  cr_assert_eq(best.column, 2);
+  cr_assert_eq(value.result, SOLVED_WIN);
+  cr_assert_eq(value.distance, 1);
+  game* other = new_game(3, 4, 5, MATRIX);
+  cr_assert_not(solvedb_lookup(db, other, &value));
+  game_free(other);
+
+  engine* e = engine_new(12);
+  engine_use_db(e, db);
+  engine_stats stats;
+  move m = engine_search(e, g, 3, 0, &stats);
+  cr_assert_eq(m.type, MOVE_DROP);
+  cr_assert_eq(m.column, 2);
+  cr_assert_eq(stats.nodes, 0);
+  cr_assert_eq(stats.score, ENGINE_WIN - 1);
+  engine_free(e);
+  solvedb_close(db);
+  game_free(g);
+}
+
+Test(record, replays_appended_games) {
+  remove("test_record.rec");
+  record_writer* w = record_writer_open("test_record.rec", 3, 4, 4, BITS);
+  move first[5] = {{MOVE_DROP, 0}, {MOVE_DROP, 1}, {MOVE_DROP, 0},
+                   {MOVE_DISARRAY, 0}, {MOVE_OFFSET, 0}};
+  record_game(w, first, 5);
+  record_writer_close(w);
+  // a second writer appends, and a game it does not end is ended on close
+  w = record_writer_open("test_record.rec", 3, 4, 4, BITS);
+  record_move(w, (move) {MOVE_DROP, 3});
+  record_writer_close(w);
+
+  game* played = new_game(3, 4, 4, BITS);
+  for (unsigned int i = 0; i < 5; i++) {
+    game_make_move(played, first[i]);
+  }
+  record_reader* r = record_reader_open("test_record.rec");
+  remove("test_record.rec");
+  cr_assert_eq(record_info(r)->width, 4);
+  game* g = new_game(3, 4, 4, BITS);
+  unsigned int n;
+  cr_assert(record_replay(r, g, &n));
+  cr_assert_eq(n, 5);
+  cr_assert_eq(game_key(g), game_key(played));
+  cr_assert(record_replay(r, g, &n));
+  cr_assert_eq(n, 1);
+  cr_assert_eq(g->col_height[3], 1);
+  cr_assert_not(record_replay(r, g, &n));
+  record_rewind(r);
+  cr_assert(record_replay(r, g, &n));
+  cr_assert_eq(n, 5);
+  record_reader_close(r);
+  game_free(g);
+  game_free(played);
+}
+
+Test(game_step, plays_entered_moves) {
+  game* g = new_game(2, 3, 3, MATRIX);
+  move m;
+  cr_assert_eq(game_step(g, '?', &m), STEP_INVALID);
+  cr_assert_eq(game_step(g, '!', &m), STEP_ILLEGAL);
+  cr_assert_eq(m.type, MOVE_OFFSET);
+  cr_assert_eq(game_step(g, '3', &m), STEP_ILLEGAL);
+  cr_assert_eq(game_step(g, '1', &m), STEP_PLAYED);
+  cr_assert_eq(m.type, MOVE_DROP);
+  cr_assert_eq(m.column, 1);
+  cr_assert_eq(move_label(m), '1');
+  cr_assert_eq(game_step(g, '^', &m), STEP_PLAYED);
+  cr_assert_eq(g->player, BLACKS_TURN);
+  cr_assert_eq(game_step(g, '2', &m), STEP_PLAYED);
+  cr_assert_eq(game_outcome(g), BLACK_WIN);
+  cr_assert_eq(game_step(g, '0', &m), STEP_OVER);
+  cr_assert_eq(g->col_height[0], 0);
+  game_free(g);
+}
+
+// batch.c tests
+/* Writes a string to a new temporary file.
+
+   @param char* the contents of the file
+   @param char* room for the path of the file, at least 32 bytes
+   */
+void write_temp(const char* contents, char* path) {
+  strcpy(path, "/tmp/moves_XXXXXX");
+  int fd = mkstemp(path);
+  cr_assert_geq(fd, 0);
+  cr_assert_eq(write(fd, contents, strlen(contents)),
+               (ssize_t) strlen(contents));
+  close(fd);
+}
+
+Test(read_moves, reads_file) {
+  char path[32];
+  write_temp("0 1\n0 1 0\n", path);
+  char* moves = read_moves(path);
+  cr_assert_str_eq(moves, "0 1\n0 1 0\n");
+  free(moves);
+  unlink(path);
+}
+
+Test(read_moves, reads_stdin_for_dash) {
+  char path[32];
+  write_temp("3344^!2", path);
+  fflush(stdin);
+  int saved = dup(STDIN_FILENO);
+  int fd = open(path, O_RDONLY);
+  dup2(fd, STDIN_FILENO);
+  close(fd);
+  clearerr(stdin);
+  char* moves = read_moves("-");
+  dup2(saved, STDIN_FILENO);
+  close(saved);
+  cr_assert_str_eq(moves, "3344^!2");
+  free(moves);
+  unlink(path);
+}
+
+Test(run_batch, plays_to_the_end) {
+  game* g = new_game(3, 5, 5, MATRIX);
+  int fds[2];
+  int saved = capture_begin(fds);
+  int status = run_batch(g, "0 1\n0 1 0 1 1", false, NULL);
+  char out[256];
+  capture_end(fds, saved, out, sizeof(out));
+  cr_assert_eq(status, 0);
+  cr_assert_eq(game_outcome(g), BLACK_WIN);
+  cr_assert_eq(g->black_queue->len, 3);
+  cr_assert_eq(g->white_queue->len, 2);
+  cr_assert_str_eq(out, "  01234\n0 .....\n1 .....\n2 *....\n3 *o...\n"
+                        "4 *o...\nOutcome: win for black after 5 moves\n");
+  game_free(g);
+}
+
+Test(run_batch, stops_at_illegal_move) {
+  game* g = new_game(3, 3, 2, MATRIX);
+  int fds[2];
+  int saved = capture_begin(fds);
+  int status = run_batch(g, "000!2", false, NULL);
+  char out[256];
+  capture_end(fds, saved, out, sizeof(out));
+  cr_assert_eq(status, 1);
+  cr_assert_eq(g->col_height[0], 2);
+  cr_assert_eq(g->col_height[1], 0);
+  cr_assert_eq(game_outcome(g), IN_PROGRESS);
+  cr_assert_str_eq(out, "Move 3 (0) is not legal.\n  012\n0 o..\n1 *..\n"
+                        "Outcome: in progress after 2 moves\n");
+  game_free(g);
+}
+
+Test(run_batch, rejects_unknown_character) {
+  game* g = new_game(3, 4, 4, MATRIX);
+  int fds[2];
+  int saved = capture_begin(fds);
+  int status = run_batch(g, "01?2", false, NULL);
+  char out[256];
+  capture_end(fds, saved, out, sizeof(out));
+  cr_assert_eq(status, 1);
+  cr_assert_eq(g->black_queue->len + g->white_queue->len, 2);
+  cr_assert_not_null(strstr(out, "Move 3 (?) is not legal.\n"));
+  game_free(g);
+}
+
+Test(run_batch, verbose_reports_every_move) {
+  game* g = new_game(2, 3, 3, MATRIX);
+  int fds[2];
+  int saved = capture_begin(fds);
+  int status = run_batch(g, "0 1 ^ 0 2", true, NULL);
+  char out[256];
+  capture_end(fds, saved, out, sizeof(out));
+  cr_assert_eq(status, 0);
+  cr_assert_str_eq(out, "1 0 in progress\n2 1 in progress\n"
+                        "3 ^ in progress\n4 0 win for white\n"
+                        "  012\n0 ...\n1 o..\n2 *o.\n"
+                        "Outcome: win for white after 4 moves\n");
+  game_free(g);
+}
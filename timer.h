@@ -0,0 +1,13 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+
+/* Finds the current time in seconds from an arbitrary starting point, on a
+   clock that never jumps, so the difference of two calls is the time that
+   passed between them. Shared by the tools that report their speed.
+
+   @return double the current time in seconds
+   */
+double now();
+
+#endif /* TIMER_H */